@@ -1,11 +1,18 @@
 #include "actions.h"
+#include "compare.h"
+#include "duplicates.h"
+#include "grep.h"
+#include "safeio.h"
 #include "utils.h"
 #include <algorithm>
 #include <cctype>
 #include <filesystem>
 #include <fstream>
+#include <limits.h>
+#include <memory>
 #include <ncurses.h>
 #include <string>
+#include <thread>
 
 namespace fs = std::filesystem;
 
@@ -16,43 +23,102 @@ std::string toLower(const std::string &s) {
   return result;
 }
 
+namespace {
+
+// How often a modal view redraws the progress of its background work
+const int PROGRESS_REFRESH_MS = 250;
+
+// The next key for a modal view, or ERR once something was posted (and run)
+// or refreshMs passed (-1 waits for a key or a post only). Keys ncurses
+// already buffered are returned without waiting.
+int waitForKey(EventLoop &loop, int refreshMs) {
+  nodelay(stdscr, TRUE);
+  int ch = getch();
+  if (ch == ERR) {
+    loop.wait(refreshMs);
+    loop.drain();
+    ch = getch();
+  }
+  nodelay(stdscr, FALSE);
+  return ch;
+}
+
+// Reports that the mount holding path missed the I/O deadline; the
+// operation may still finish in the background.
+void showUnresponsive(const std::string &path) {
+  mvprintw(LINES / 2 + 1, (COLS - 30) / 2, "Not responding: %s, press any key!",
+           unresponsiveMount(path).c_str());
+  refresh();
+  getch();
+}
+
+// Removes path and, for a directory, everything in it. Notes progress per
+// entry so a large but healthy tree isn't cut off by the deadline.
+void removeTree(const fs::path &path) {
+  if (fs::is_directory(fs::symlink_status(path))) {
+    for (const auto &entry : fs::directory_iterator(path))
+      removeTree(entry.path());
+  }
+  fs::remove(path);
+  noteIoProgress();
+}
+
+// Asks "Delete?" at row, col and on y removes path, a directory with
+// everything in it. Failures are reported and leave it in place.
+bool confirmAndDelete(const std::string &path, int row, int col) {
+  mvprintw(row, col, "%s", "Delete?");
+  refresh();
+
+  int confirm = getch();
+  if (confirm != 'y' && confirm != 'Y')
+    return false;
+  // Owned by the removal, which outlives this call if the mount hangs
+  auto removed = std::make_shared<bool>(false);
+  if (!runWithDeadline(path, [path, removed]() {
+        try {
+          removeTree(path);
+          *removed = true;
+        } catch (const std::exception &e) {
+        }
+      })) {
+    showUnresponsive(path);
+    return false;
+  }
+  if (!*removed) {
+    mvprintw(LINES / 2 + 1, (COLS - 30) / 2,
+             "Error: Could not delete file, press any key!");
+    refresh();
+    getch();
+    return false;
+  }
+  return true;
+}
+
+// What extracting an archive member came to
+enum class ExtractOutcome { Failed, Exists, Extracted };
+
+} // namespace
+
 bool handleDeleteAction(const std::string &currentPath,
-                        std::vector<std::pair<std::string, bool>> &currentFiles,
+                        std::vector<FileEntry> &currentFiles,
                         int &selectedIndex, int topIndex) {
   if (currentFiles.empty() || selectedIndex >= (int)currentFiles.size()) {
     return false;
   }
 
-  std::string confirmMsg = "Delete?";
-  mvprintw(selectedIndex - topIndex + 1, 50, "%s", confirmMsg.c_str());
-  refresh();
-
-  int confirm = getch();
-  if (confirm == 'y' || confirm == 'Y') {
-    try {
-      std::string fullPath = BUILD_FULL_PATH;
-      if (currentFiles[selectedIndex].second) {
-        fs::remove_all(fullPath);
-      } else {
-        fs::remove(fullPath);
-      }
-      currentFiles = getDirectoryContents(currentPath);
-      if (selectedIndex >= (int)currentFiles.size()) {
-        selectedIndex = currentFiles.size() - 1;
-      }
-      return true;
-    } catch (const std::exception &e) {
-      mvprintw(LINES / 2 + 1, (COLS - 30) / 2,
-               "Error: Could not delete file, press any key!");
-      refresh();
-      getch();
-    }
+  if (!confirmAndDelete(BUILD_FULL_PATH, selectedIndex - topIndex + 1, 50))
+    return false;
+  // The cursor moves to the next row; the caller rereads the listing
+  invalidateDirectoryListing(currentPath);
+  currentFiles.erase(currentFiles.begin() + selectedIndex);
+  if (selectedIndex >= (int)currentFiles.size()) {
+    selectedIndex = currentFiles.size() - 1;
   }
-  return false;
+  return true;
 }
 
 bool handleRenameAction(const std::string &currentPath,
-                        std::vector<std::pair<std::string, bool>> &currentFiles,
+                        std::vector<FileEntry> &currentFiles,
                         int &selectedIndex, int topIndex) {
   if (currentFiles.empty() || selectedIndex >= (int)currentFiles.size()) {
     return false;
@@ -74,20 +140,26 @@ bool handleRenameAction(const std::string &currentPath,
     noecho();    // Disable echo again
     curs_set(0); // Hide cursor
 
-    try {
-      std::string fullOldPath = BUILD_FULL_PATH;
-
-      std::string fullNewPath = currentPath == "/"
-                                    ? currentPath + newName
-                                    : currentPath + "/" + newName;
-
-      fs::rename(fullOldPath, fullNewPath);
-      currentFiles = getDirectoryContents(currentPath);
-      if (selectedIndex >= (int)currentFiles.size()) {
-        selectedIndex = currentFiles.size() - 1;
-      }
+    std::string fullOldPath = BUILD_FULL_PATH;
+
+    std::string fullNewPath = currentPath == "/"
+                                  ? currentPath + newName
+                                  : currentPath + "/" + newName;
+
+    auto renamed = std::make_shared<bool>(false);
+    if (!runWithDeadline(fullOldPath, [fullOldPath, fullNewPath, renamed]() {
+          std::error_code error;
+          fs::rename(fullOldPath, fullNewPath, error);
+          *renamed = !error;
+        })) {
+      showUnresponsive(fullOldPath);
+    } else if (*renamed) {
+      // The row keeps the cursor under its new name; the caller rereads the
+      // listing
+      invalidateDirectoryListing(currentPath);
+      currentFiles[selectedIndex].name = newName;
       return true;
-    } catch (const std::exception &e) {
+    } else {
       mvprintw(LINES / 2 + 1, (COLS - 30) / 2,
                "Error: Could not rename, press any key!");
       refresh();
@@ -97,19 +169,25 @@ bool handleRenameAction(const std::string &currentPath,
   return false;
 }
 
-bool handleEnterDirectoryAction(
-    std::string &currentPath,
-    std::vector<std::pair<std::string, bool>> &currentFiles, int &selectedIndex,
-    int &topIndex) {
+bool handleEnterDirectoryAction(std::string &currentPath,
+                                std::vector<FileEntry> &currentFiles,
+                                int &selectedIndex, int &topIndex,
+                                DirectoryPrefetcher *prefetcher) {
   if (currentFiles.empty() || selectedIndex >= (int)currentFiles.size() ||
-      !currentFiles[selectedIndex].second) {
+      !currentFiles[selectedIndex].isDir) {
     return false;
   }
 
   try {
     std::string newPath = BUILD_FULL_PATH;
     currentPath = newPath;
-    currentFiles = getDirectoryContents(currentPath);
+    // Swap in a speculatively loaded listing when one is ready
+    std::vector<FileEntry> prefetched;
+    if (prefetcher && prefetcher->take(currentPath, prefetched)) {
+      currentFiles = filterDirectoryContents(currentPath, prefetched);
+    } else {
+      currentFiles = getDirectoryContents(currentPath);
+    }
     selectedIndex = 0;
     topIndex = 0;
     return true;
@@ -123,7 +201,7 @@ bool handleEnterDirectoryAction(
 }
 
 bool handleGoBackAction(std::string &currentPath,
-                        std::vector<std::pair<std::string, bool>> &currentFiles,
+                        std::vector<FileEntry> &currentFiles,
                         int &selectedIndex, int &topIndex) {
   if (currentPath == "/") {
     return false; // Already at root
@@ -150,7 +228,154 @@ bool handleGoBackAction(std::string &currentPath,
   }
 }
 
-bool handleSearchAction(std::vector<std::pair<std::string, bool>> &currentFiles,
+namespace {
+
+void selectByName(const std::vector<FileEntry> &currentFiles,
+                  const std::string &name, int &selectedIndex, int &topIndex) {
+  selectedIndex = 0;
+  for (size_t i = 0; i < currentFiles.size(); ++i) {
+    if (currentFiles[i].name == name) {
+      selectedIndex = i;
+      break;
+    }
+  }
+  topIndex = std::max(0, selectedIndex - (LINES - 3) / 2);
+}
+
+// Opens the directory holding path with path selected
+void jumpToFile(const std::string &path, std::string &currentPath,
+                std::vector<FileEntry> &currentFiles, int &selectedIndex,
+                int &topIndex) {
+  fs::path file(path);
+  currentPath = file.parent_path().string();
+  currentFiles = getDirectoryContents(currentPath);
+  selectByName(currentFiles, file.filename().string(), selectedIndex,
+               topIndex);
+}
+
+// Lists the archive's current directory through the usual filters and sort
+void showArchiveDirectory(const ArchiveBrowser &archive,
+                          std::string &currentPath,
+                          std::vector<FileEntry> &currentFiles) {
+  currentPath = archive.displayPath();
+  currentFiles = filterDirectoryContents(
+      currentPath, archive.list(archive.getInnerPath()));
+}
+
+} // namespace
+
+bool handleOpenArchiveAction(ArchiveBrowser &archive, std::string &currentPath,
+                             std::vector<FileEntry> &currentFiles,
+                             int &selectedIndex, int &topIndex) {
+  if (currentFiles.empty() || selectedIndex >= (int)currentFiles.size() ||
+      currentFiles[selectedIndex].isDir) {
+    return false;
+  }
+
+  if (!archive.open(BUILD_FULL_PATH))
+    return false;
+  showArchiveDirectory(archive, currentPath, currentFiles);
+  selectedIndex = 0;
+  topIndex = 0;
+  return true;
+}
+
+bool handleArchiveEnterAction(ArchiveBrowser &archive,
+                              std::string &currentPath,
+                              std::vector<FileEntry> &currentFiles,
+                              int &selectedIndex, int &topIndex) {
+  if (currentFiles.empty() || selectedIndex >= (int)currentFiles.size() ||
+      !archive.enter(currentFiles[selectedIndex].name)) {
+    return false;
+  }
+
+  showArchiveDirectory(archive, currentPath, currentFiles);
+  selectedIndex = 0;
+  topIndex = 0;
+  return true;
+}
+
+void handleArchiveBackAction(ArchiveBrowser &archive, std::string &currentPath,
+                             std::vector<FileEntry> &currentFiles,
+                             int &selectedIndex, int &topIndex) {
+  // Land on the directory (or archive) we came out of
+  std::string from = currentPath.substr(currentPath.find_last_of('/') + 1);
+  if (archive.leave()) {
+    showArchiveDirectory(archive, currentPath, currentFiles);
+  } else {
+    size_t lastSlash = archive.getArchivePath().find_last_of('/');
+    currentPath = lastSlash == 0 ? "/"
+                                 : archive.getArchivePath().substr(0, lastSlash);
+    archive.close();
+    currentFiles = getDirectoryContents(currentPath);
+  }
+  selectByName(currentFiles, from, selectedIndex, topIndex);
+}
+
+void handleExtractMemberAction(const ArchiveBrowser &archive,
+                               const std::vector<FileEntry> &currentFiles,
+                               int selectedIndex) {
+  if (currentFiles.empty() || selectedIndex >= (int)currentFiles.size()) {
+    return;
+  }
+
+  const std::string &name = currentFiles[selectedIndex].name;
+  const ArchiveMember *member = archive.find(name);
+  const std::string &archivePath = archive.getArchivePath();
+  std::string destPath =
+      archivePath.substr(0, archivePath.find_last_of('/') + 1) + name;
+  move(LINES - 1, 0);
+  clrtoeol();
+  attron(A_DIM);
+  if (!member || member->isDir) {
+    printw("Only files can be extracted");
+  } else if (name.empty() || name == "." || name == ".." ||
+             name.find('/') != std::string::npos) {
+    // Would land outside the archive's directory or on the directory itself
+    printw("Cannot extract a member named \"%s\"", name.c_str());
+  } else if (!member->readable) {
+    printw("Encrypted or unsupported compression: %s", name.c_str());
+  } else {
+    // Owned by the extraction, which outlives this call if the mount hangs
+    auto outcome = std::make_shared<ExtractOutcome>(ExtractOutcome::Failed);
+    bool finished = runWithDeadline(
+        archivePath, [archivePath, member = *member, destPath, outcome]() {
+          std::error_code error;
+          if (fs::exists(destPath, error))
+            *outcome = ExtractOutcome::Exists;
+          else if (extractArchiveMember(archivePath, member, destPath))
+            *outcome = ExtractOutcome::Extracted;
+        });
+    if (!finished)
+      printw("Not responding: %s", unresponsiveMount(archivePath).c_str());
+    else if (*outcome == ExtractOutcome::Exists)
+      printw("Already exists: %s", destPath.c_str());
+    else if (*outcome == ExtractOutcome::Extracted)
+      printw("Extracted to %s", destPath.c_str());
+    else
+      printw("Error: Could not extract %s", name.c_str());
+  }
+  printw(" (press any key)");
+  attroff(A_DIM);
+  refresh();
+  getch();
+}
+
+void findSearchMatches(const std::vector<FileEntry> &currentFiles,
+                       const std::string &searchTerm,
+                       std::vector<int> &matchIndices) {
+  // Case-insensitive substring match
+  std::string lowerSearchTerm = toLower(searchTerm);
+  matchIndices.clear();
+  for (size_t i = 0; i < currentFiles.size(); ++i) {
+    std::string lowerFilename = toLower(currentFiles[i].name);
+    if (lowerFilename.find(lowerSearchTerm) != std::string::npos) {
+      matchIndices.push_back(i);
+    }
+  }
+}
+
+bool handleSearchAction(std::vector<FileEntry> &currentFiles,
                         int &selectedIndex, int &topIndex,
                         std::string &searchTerm, std::vector<int> &matchIndices,
                         int &currentMatchIndex) {
@@ -182,16 +407,7 @@ bool handleSearchAction(std::vector<std::pair<std::string, bool>> &currentFiles,
     return false;
   }
 
-  // Convert search term to lowercase for case-insensitive search
-  std::string lowerSearchTerm = toLower(searchTerm);
-
-  // Find all matches
-  for (size_t i = 0; i < currentFiles.size(); ++i) {
-    std::string lowerFilename = toLower(currentFiles[i].first);
-    if (lowerFilename.find(lowerSearchTerm) != std::string::npos) {
-      matchIndices.push_back(i);
-    }
-  }
+  findSearchMatches(currentFiles, searchTerm, matchIndices);
 
   // If matches found, navigate to the first one
   if (!matchIndices.empty()) {
@@ -228,9 +444,21 @@ void navigateToNextMatch(std::vector<int> &matchIndices, int &currentMatchIndex,
     return;
   }
 
-  // Update current match index (wrap around if needed)
-  currentMatchIndex = (currentMatchIndex + direction + matchIndices.size()) %
-                      matchIndices.size();
+  // The match after (or before) the cursor, wrapping around; the cursor
+  // may have moved off the matches since the last jump
+  auto next = direction > 0
+                  ? std::upper_bound(matchIndices.begin(), matchIndices.end(),
+                                     selectedIndex)
+                  : std::lower_bound(matchIndices.begin(), matchIndices.end(),
+                                     selectedIndex);
+  if (direction > 0) {
+    currentMatchIndex =
+        next == matchIndices.end() ? 0 : next - matchIndices.begin();
+  } else {
+    currentMatchIndex = next == matchIndices.begin()
+                            ? matchIndices.size() - 1
+                            : next - matchIndices.begin() - 1;
+  }
 
   // Update selected index to point to the match
   selectedIndex = matchIndices[currentMatchIndex];
@@ -259,7 +487,7 @@ void exitSearchMode(std::string &searchTerm, std::vector<int> &matchIndices,
 }
 void handleCopyPathAction(
     const std::string &currentPath,
-    const std::vector<std::pair<std::string, bool>> &currentFiles,
+    const std::vector<FileEntry> &currentFiles,
     int selectedIndex) {
   if (currentFiles.empty() || selectedIndex >= (int)currentFiles.size()) {
     return;
@@ -333,7 +561,7 @@ std::vector<std::string> getBookmarks() {
 
 bool handleBookmarkListAction(
     std::string &currentPath,
-    std::vector<std::pair<std::string, bool>> &currentFiles, int &selectedIndex,
+    std::vector<FileEntry> &currentFiles, int &selectedIndex,
     int &topIndex) {
   std::vector<std::string> bookmarks = getBookmarks();
 
@@ -389,8 +617,15 @@ bool handleBookmarkListAction(
     } else if (ch == KEY_ENTER || ch == '\n' || ch == '\r') {
       if (!bookmarks.empty() && bookmarkIndex < (int)bookmarks.size()) {
         std::string selectedPath = bookmarks[bookmarkIndex];
+        struct stat st;
+        IoStatus status = statWithDeadline(selectedPath, st);
 
-        if (fs::exists(selectedPath)) {
+        if (status == IoStatus::Unresponsive) {
+          mvprintw(LINES - 1, 0, "Not responding: %s",
+                   unresponsiveMount(selectedPath).c_str());
+          refresh();
+          getch();
+        } else if (status == IoStatus::Ok) {
           currentPath = selectedPath;
           currentFiles = getDirectoryContents(currentPath);
           selectedIndex = 0;
@@ -434,3 +669,507 @@ bool handleBookmarkListAction(
 
   return false;
 }
+
+bool handleContentSearchAction(std::string &currentPath,
+                               std::vector<FileEntry> &currentFiles,
+                               int &selectedIndex, int &topIndex,
+                               EventLoop &loop) {
+  move(LINES - 1, 0);
+  clrtoeol();
+  attron(A_DIM);
+  printw("grep (text, or /regex/): ");
+  attroff(A_DIM);
+  echo();
+  curs_set(1);
+  char input[256] = {0};
+  getnstr(input, sizeof(input) - 1);
+  noecho();
+  curs_set(0);
+
+  GrepOptions options;
+  options.pattern = input;
+  if (options.pattern.size() > 2 && options.pattern.front() == '/' &&
+      options.pattern.back() == '/') {
+    options.regex = true;
+    options.pattern = options.pattern.substr(1, options.pattern.size() - 2);
+  }
+  // Smart case: only a pattern with capitals is matched case-sensitively
+  options.ignoreCase =
+      std::none_of(options.pattern.begin(), options.pattern.end(),
+                   [](unsigned char c) { return std::isupper(c); });
+  if (options.pattern.empty())
+    return false;
+
+  std::string root = currentPath;
+  ContentSearch search;
+  std::string error;
+  EventLoop::Poster poster = loop.poster();
+  if (!search.start(root, &getScanMatcher(), options, error,
+                    [poster]() { poster.post([]() {}); })) {
+    mvprintw(LINES - 1, 0, "Error: %s, press any key!", error.c_str());
+    refresh();
+    getch();
+    return false;
+  }
+
+  std::string prefix = root == "/" ? root : root + "/";
+  std::vector<GrepHit> hits;
+  bool searching = true;
+  int hitIndex = 0;
+  int hitTopIndex = 0;
+  while (true) {
+    // New hits and the end of the search wake the wait below
+    searching = searching && search.take(hits);
+
+    clear();
+    mvprintw(0, 0, "grep %s: %zu hits in %zu files%s (q to exit, Enter to go "
+                   "to file):",
+             input, hits.size(), search.filesSearched(),
+             searching                  ? ", searching..."
+             : search.reachedHitLimit() ? ", stopped at the limit"
+                                        : "");
+
+    int row = 2;
+    for (size_t i = hitTopIndex; i < hits.size() && row < LINES - 1;
+         ++i, ++row) {
+      const GrepHit &hit = hits[i];
+      std::string text = hit.text;
+      for (char &c : text) {
+        if (c == '\t' || c == '\r')
+          c = ' ';
+      }
+      size_t start = text.find_first_not_of(' ');
+      if (start != std::string::npos)
+        text.erase(0, start);
+
+      if ((int)i == hitIndex)
+        attron(A_REVERSE);
+      move(row, 1);
+      attron(A_BOLD);
+      printw("%s:%zu",
+             hit.path.compare(0, prefix.size(), prefix) == 0
+                 ? hit.path.c_str() + prefix.size()
+                 : hit.path.c_str(),
+             hit.line);
+      attroff(A_BOLD);
+      printw(": ");
+      int x = getcurx(stdscr);
+      addnstr(text.c_str(), std::max(0, COLS - x - 1));
+      if ((int)i == hitIndex)
+        attroff(A_REVERSE);
+    }
+
+    refresh();
+
+    int ch = waitForKey(loop, searching ? PROGRESS_REFRESH_MS : -1);
+
+    if (ch == 'q') {
+      break;
+    } else if (ch == KEY_UP || ch == 'k') {
+      if (hitIndex > 0) {
+        hitIndex--;
+        if (hitIndex < hitTopIndex) {
+          hitTopIndex = hitIndex;
+        }
+      }
+    } else if (ch == KEY_DOWN || ch == 'j') {
+      if (hitIndex < (int)hits.size() - 1) {
+        hitIndex++;
+        if (hitIndex >= hitTopIndex + LINES - 3) {
+          hitTopIndex = hitIndex - LINES + 4;
+        }
+      }
+    } else if ((ch == KEY_ENTER || ch == '\n' || ch == '\r') &&
+               hitIndex < (int)hits.size()) {
+      jumpToFile(hits[hitIndex].path, currentPath, currentFiles,
+                 selectedIndex, topIndex);
+      return true;
+    }
+  }
+
+  return false; // search cancels itself on the way out
+}
+
+bool handleDuplicatesAction(std::string &currentPath,
+                            std::vector<FileEntry> &currentFiles,
+                            int &selectedIndex, int &topIndex,
+                            EventLoop &loop) {
+  // The scan runs detached so cancelling never waits on a slow disk
+  struct DuplicateScan {
+    DuplicateScanProgress progress;
+    std::vector<DuplicateGroup> groups;
+    std::atomic<bool> done{false};
+  };
+  auto scan = std::make_shared<DuplicateScan>();
+  std::string root = currentPath;
+  std::thread([scan, root, poster = loop.poster()]() {
+    scan->groups = findDuplicates(root, &getScanMatcher(), scan->progress);
+    scan->done = true;
+    poster.post([]() {}); // Wake the progress view
+  }).detach();
+
+  while (!scan->done) {
+    clear();
+    mvprintw(0, 0, "Finding duplicates under %s (q to cancel)", root.c_str());
+    mvprintw(2, 1, "%zu files scanned, %zu hashed",
+             scan->progress.filesSeen.load(),
+             scan->progress.filesHashed.load());
+    refresh();
+    if (waitForKey(loop, PROGRESS_REFRESH_MS) == 'q') {
+      scan->progress.cancelled = true;
+      return false;
+    }
+  }
+
+  std::vector<DuplicateGroup> &groups = scan->groups;
+  std::string prefix = root == "/" ? root : root + "/";
+  // One row per group header and per file; rows[i] = {group, file or -1}
+  std::vector<std::pair<int, int>> rows;
+  auto buildRows = [&]() {
+    rows.clear();
+    for (size_t g = 0; g < groups.size(); ++g) {
+      rows.emplace_back(g, -1);
+      for (size_t f = 0; f < groups[g].paths.size(); ++f)
+        rows.emplace_back(g, f);
+    }
+  };
+  buildRows();
+
+  int rowIndex = 1; // First file of the first group
+  int rowTopIndex = 0;
+  while (true) {
+    clear();
+
+    if (groups.empty()) {
+      mvprintw(LINES / 2, (COLS - 20) / 2, "No duplicates found");
+      refresh();
+      getch();
+      return false;
+    }
+
+    uint64_t reclaimable = 0;
+    for (const auto &group : groups)
+      reclaimable += group.size * (group.paths.size() - 1);
+    mvprintw(0, 0,
+             "Duplicates: %zu groups, %s reclaimable (q to exit, Enter to go "
+             "to file, d to delete):",
+             groups.size(), formatSize(reclaimable).c_str());
+
+    int row = 2;
+    for (size_t i = rowTopIndex; i < rows.size() && row < LINES - 1;
+         ++i, ++row) {
+      const DuplicateGroup &group = groups[rows[i].first];
+      if (rows[i].second < 0) {
+        attron(A_BOLD);
+        mvprintw(row, 1, "%s x %zu", formatSize(group.size).c_str(),
+                 group.paths.size());
+        attroff(A_BOLD);
+        continue;
+      }
+      const std::string &path = group.paths[rows[i].second];
+      if ((int)i == rowIndex)
+        attron(A_REVERSE);
+      mvprintw(row, 3, "%s",
+               path.compare(0, prefix.size(), prefix) == 0
+                   ? path.c_str() + prefix.size()
+                   : path.c_str());
+      if ((int)i == rowIndex)
+        attroff(A_REVERSE);
+    }
+
+    refresh();
+
+    int ch = getch();
+
+    if (ch == 'q') {
+      break;
+    } else if (ch == KEY_UP || ch == 'k') {
+      // Group headers can't be selected
+      int target = rowIndex - 1;
+      if (target >= 0 && rows[target].second < 0)
+        target--;
+      if (target >= 0)
+        rowIndex = target;
+      if (rowIndex - 1 < rowTopIndex)
+        rowTopIndex = std::max(0, rowIndex - 1);
+    } else if (ch == KEY_DOWN || ch == 'j') {
+      int target = rowIndex + 1;
+      if (target < (int)rows.size() && rows[target].second < 0)
+        target++;
+      if (target < (int)rows.size())
+        rowIndex = target;
+      if (rowIndex >= rowTopIndex + LINES - 3)
+        rowTopIndex = rowIndex - LINES + 4;
+    } else if (ch == KEY_ENTER || ch == '\n' || ch == '\r') {
+      jumpToFile(groups[rows[rowIndex].first].paths[rows[rowIndex].second],
+                 currentPath, currentFiles, selectedIndex, topIndex);
+      return true;
+    } else if (ch == 'd') {
+      DuplicateGroup &group = groups[rows[rowIndex].first];
+      const std::string &path = group.paths[rows[rowIndex].second];
+      // The scan may be stale: only delete while another copy still matches
+      const std::string &other =
+          group.paths[rows[rowIndex].second == 0 ? 1 : 0];
+      std::atomic<bool> never{false};
+      if (!sameFileContents(path, other, never)) {
+        mvprintw(LINES - 1, 0, "No longer identical to %s, press any key",
+                 other.c_str());
+        refresh();
+        getch();
+        continue;
+      }
+      move(LINES - 1, 0);
+      clrtoeol();
+      if (!confirmAndDelete(path, LINES - 1, 0))
+        continue;
+      group.paths.erase(group.paths.begin() + rows[rowIndex].second);
+      // A lone survivor is no longer a duplicate
+      if (group.paths.size() < 2)
+        groups.erase(groups.begin() + rows[rowIndex].first);
+      buildRows();
+      if (rowIndex >= (int)rows.size())
+        rowIndex = rows.size() - 1;
+      if (rowIndex >= 0 && rows[rowIndex].second < 0)
+        rowIndex = rowIndex + 1 < (int)rows.size() ? rowIndex + 1
+                                                   : rowIndex - 1;
+      rowIndex = std::max(rowIndex, 0);
+      rowTopIndex = std::min(rowTopIndex, std::max(0, rowIndex - 1));
+    }
+  }
+
+  return false;
+}
+
+namespace {
+
+// One cell of the compare view: the path and, at the right edge of the
+// cell, its size and time
+void drawCompareCell(int row, int col, int width, const CompareEntry &entry,
+                     bool present, uint64_t size, time_t mtime) {
+  if (!present || width < 4)
+    return;
+  const char *marker = entry.status == CompareStatus::OnlyLeft    ? "< "
+                       : entry.status == CompareStatus::OnlyRight ? "> "
+                                                                  : "~ ";
+  std::string details =
+      entry.isDir ? "dir" : formatSize(size) + "  " + formatModTime(mtime);
+  int detailsCol = col + width - (int)details.size();
+  mvaddnstr(row, col, marker, 2);
+  addnstr(entry.path.c_str(), std::max(0, detailsCol - col - 3));
+  if (detailsCol > col + 8) {
+    attron(A_DIM);
+    mvaddstr(row, detailsCol, details.c_str());
+    attroff(A_DIM);
+  }
+}
+
+const char *diffReasonLabel(DiffReason reason) {
+  switch (reason) {
+  case DiffReason::Type:
+    return "type";
+  case DiffReason::Size:
+    return "size";
+  case DiffReason::Time:
+    return "modified time";
+  case DiffReason::Content:
+    return "contents";
+  case DiffReason::LinkTarget:
+    return "link target";
+  case DiffReason::None:
+    break;
+  }
+  return "";
+}
+
+} // namespace
+
+bool handleCompareAction(std::string &currentPath,
+                         std::vector<FileEntry> &currentFiles,
+                         int &selectedIndex, int &topIndex, EventLoop &loop) {
+  // Ask for the other tree, offering the bookmarks by number
+  std::vector<std::string> bookmarks = getBookmarks();
+  clear();
+  mvprintw(0, 0, "Compare %s with (a path, or a bookmark number):",
+           currentPath.c_str());
+  for (size_t i = 0; i < bookmarks.size() && (int)i + 2 < LINES - 1; ++i)
+    mvprintw(i + 2, 1, "%zu  %s", i + 1, bookmarks[i].c_str());
+  move(LINES - 1, 0);
+  attron(A_DIM);
+  printw("compare with: ");
+  attroff(A_DIM);
+  echo();
+  curs_set(1);
+  char input[PATH_MAX] = {0};
+  getnstr(input, sizeof(input) - 1);
+  noecho();
+  curs_set(0);
+
+  std::string other = input;
+  if (other.empty())
+    return false;
+  if (other.find_first_not_of("0123456789") == std::string::npos) {
+    size_t number = std::stoul(other);
+    if (number >= 1 && number <= bookmarks.size())
+      other = bookmarks[number - 1];
+  } else if (other[0] == '~') {
+    other = (getenv("HOME") ? getenv("HOME") : "") + other.substr(1);
+  } else if (other[0] != '/') {
+    other = (currentPath == "/" ? currentPath : currentPath + "/") + other;
+  }
+  // Lexically, so a stale mount can't hang it
+  other = fs::path(other).lexically_normal().string();
+  while (other.size() > 1 && other.back() == '/')
+    other.pop_back();
+  struct stat st;
+  if (statWithDeadline(other, st) != IoStatus::Ok || !S_ISDIR(st.st_mode)) {
+    mvprintw(LINES - 1, 0, "Not a directory: %s, press any key!",
+             other.c_str());
+    clrtoeol();
+    refresh();
+    getch();
+    return false;
+  }
+
+  const std::string roots[2] = {currentPath, other};
+  CompareOptions options;
+  TreeComparison comparison;
+  EventLoop::Poster poster = loop.poster();
+  auto ready = [poster]() { poster.post([]() {}); };
+  comparison.start(roots[0], roots[1], &getScanMatcher(), options, ready);
+
+  std::vector<CompareEntry> entries;
+  bool comparing = true;
+  int entryIndex = 0;
+  int entryTopIndex = 0;
+  int side = 0; // Which tree Enter opens
+  auto byPath = [](const CompareEntry &a, const CompareEntry &b) {
+    return comparePathLess(a.path, b.path);
+  };
+  while (true) {
+    // New entries arrive in walk order; merge them in so the list stays
+    // sorted and the selection stays on the same entry
+    size_t before = entries.size();
+    comparing = comparing && comparison.take(entries);
+    if (entries.size() > before) {
+      std::string selectedPath =
+          entryIndex < (int)before ? entries[entryIndex].path : "";
+      std::sort(entries.begin() + before, entries.end(), byPath);
+      std::inplace_merge(entries.begin(), entries.begin() + before,
+                         entries.end(), byPath);
+      if (!selectedPath.empty()) {
+        CompareEntry key;
+        key.path = selectedPath;
+        entryIndex = std::lower_bound(entries.begin(), entries.end(), key,
+                                      byPath) -
+                     entries.begin();
+      }
+    }
+
+    clear();
+    char header[256];
+    snprintf(header, sizeof(header),
+             "%zu only left, %zu only right, %zu differ, %zu identical%s%s "
+             "(q to exit, Enter to go to file, Tab to switch side, c to %s "
+             "contents):",
+             comparison.count(CompareStatus::OnlyLeft),
+             comparison.count(CompareStatus::OnlyRight),
+             comparison.count(CompareStatus::Differs), comparison.identical(),
+             options.compareContents ? " by contents" : "",
+             comparing                        ? ", comparing..."
+             : comparison.reachedEntryLimit() ? ", stopped listing at the limit"
+                                              : "",
+             options.compareContents ? "skip" : "compare");
+    mvaddnstr(0, 0, header, COLS);
+
+    int half = COLS / 2;
+    int cellWidth = half - 2;
+    for (int s = 0; s < 2; ++s) {
+      attron(A_BOLD);
+      mvaddnstr(1, s * half + 1, roots[s].c_str(), cellWidth);
+      attroff(A_BOLD);
+    }
+    mvvline(1, half - 1, ACS_VLINE, LINES - 2);
+
+    int row = 2;
+    for (size_t i = entryTopIndex; i < entries.size() && row < LINES - 1;
+         ++i, ++row) {
+      const CompareEntry &entry = entries[i];
+      bool present[2] = {entry.status != CompareStatus::OnlyRight,
+                         entry.status != CompareStatus::OnlyLeft};
+      for (int s = 0; s < 2; ++s) {
+        bool highlight = (int)i == entryIndex && s == side;
+        if (highlight)
+          attron(A_REVERSE);
+        else if (entry.status == CompareStatus::Differs)
+          attron(A_BOLD);
+        if (highlight && !present[s])
+          mvhline(row, s * half + 1, ' ', cellWidth);
+        drawCompareCell(row, s * half + 1, cellWidth, entry, present[s],
+                        s == 0 ? entry.leftSize : entry.rightSize,
+                        s == 0 ? entry.leftMtime : entry.rightMtime);
+        attroff(A_REVERSE | A_BOLD);
+      }
+    }
+
+    if (entryIndex < (int)entries.size()) {
+      const CompareEntry &entry = entries[entryIndex];
+      attron(A_DIM);
+      if (entry.status == CompareStatus::Differs)
+        mvprintw(LINES - 1, 0, "differs: %s", diffReasonLabel(entry.reason));
+      else
+        mvprintw(LINES - 1, 0, "only in %s",
+                 roots[entry.status == CompareStatus::OnlyLeft ? 0 : 1]
+                     .c_str());
+      attroff(A_DIM);
+    } else if (!comparing && entries.empty()) {
+      mvprintw(LINES / 2, (COLS - 30) / 2, "The trees are identical");
+    }
+
+    refresh();
+
+    int ch = waitForKey(loop, comparing ? PROGRESS_REFRESH_MS : -1);
+    int page = std::max(1, LINES - 3);
+
+    if (ch == 'q') {
+      break;
+    } else if (ch == KEY_UP || ch == 'k') {
+      entryIndex = std::max(0, entryIndex - 1);
+    } else if (ch == KEY_DOWN || ch == 'j') {
+      entryIndex = std::min(entryIndex + 1, std::max(0, (int)entries.size() - 1));
+    } else if (ch == KEY_NPAGE || ch == KEY_PPAGE) {
+      entryIndex += ch == KEY_NPAGE ? page : -page;
+      entryIndex = std::max(0, std::min(entryIndex, (int)entries.size() - 1));
+    } else if (ch == 'g') {
+      entryIndex = 0;
+    } else if (ch == 'G') {
+      entryIndex = std::max(0, (int)entries.size() - 1);
+    } else if (ch == '\t') {
+      side = 1 - side;
+    } else if (ch == 'c') {
+      // Restart, deciding files of equal size by contents or by mtime
+      options.compareContents = !options.compareContents;
+      comparison.start(roots[0], roots[1], &getScanMatcher(), options, ready);
+      entries.clear();
+      comparing = true;
+      entryIndex = 0;
+    } else if ((ch == KEY_ENTER || ch == '\n' || ch == '\r') &&
+               entryIndex < (int)entries.size()) {
+      const CompareEntry &entry = entries[entryIndex];
+      // Open the side that has the entry when the chosen one doesn't
+      int open = entry.status == CompareStatus::OnlyLeft    ? 0
+                 : entry.status == CompareStatus::OnlyRight ? 1
+                                                            : side;
+      const std::string &root = roots[open];
+      jumpToFile((root == "/" ? root : root + "/") + entry.path, currentPath,
+                 currentFiles, selectedIndex, topIndex);
+      return true;
+    }
+
+    if (entryIndex < entryTopIndex)
+      entryTopIndex = entryIndex;
+    else if (entryIndex >= entryTopIndex + LINES - 3)
+      entryTopIndex = entryIndex - LINES + 4;
+  }
+
+  return false; // comparison cancels itself on the way out
+}
@@ -1,5 +1,9 @@
 #pragma once
 
+#include "archive.h"
+#include "eventloop.h"
+#include "prefetch.h"
+#include "utils.h"
 #include <ncurses.h>
 #include <string>
 #include <utility>
@@ -7,31 +11,61 @@
 
 #define BUILD_FULL_PATH                                                        \
   ((currentPath == "/")                                                        \
-       ? (currentPath + currentFiles[selectedIndex].first)                     \
-       : (currentPath + "/" + currentFiles[selectedIndex].first))
+       ? (currentPath + currentFiles[selectedIndex].name)                     \
+       : (currentPath + "/" + currentFiles[selectedIndex].name))
 
+// Delete and rename update the row in memory (removed, or renamed with the
+// cursor still on it) and leave rereading the directory to the caller.
 bool handleDeleteAction(const std::string &currentPath,
-                        std::vector<std::pair<std::string, bool>> &currentFiles,
+                        std::vector<FileEntry> &currentFiles,
                         int &selectedIndex, int topIndex);
 
 bool handleRenameAction(const std::string &currentPath,
-                        std::vector<std::pair<std::string, bool>> &currentFiles,
+                        std::vector<FileEntry> &currentFiles,
                         int &selectedIndex, int topIndex);
 
-bool handleEnterDirectoryAction(
-    std::string &currentPath,
-    std::vector<std::pair<std::string, bool>> &currentFiles, int &selectedIndex,
-    int &topIndex);
+bool handleEnterDirectoryAction(std::string &currentPath,
+                                std::vector<FileEntry> &currentFiles,
+                                int &selectedIndex, int &topIndex,
+                                DirectoryPrefetcher *prefetcher = nullptr);
 
 bool handleGoBackAction(std::string &currentPath,
-                        std::vector<std::pair<std::string, bool>> &currentFiles,
+                        std::vector<FileEntry> &currentFiles,
                         int &selectedIndex, int &topIndex);
 
-bool handleSearchAction(std::vector<std::pair<std::string, bool>> &currentFiles,
+// Opens the selected file as a virtual directory if it is a tar or zip
+// archive. Returns false for other files.
+bool handleOpenArchiveAction(ArchiveBrowser &archive, std::string &currentPath,
+                             std::vector<FileEntry> &currentFiles,
+                             int &selectedIndex, int &topIndex);
+
+// Enters the selected directory inside the open archive.
+bool handleArchiveEnterAction(ArchiveBrowser &archive,
+                              std::string &currentPath,
+                              std::vector<FileEntry> &currentFiles,
+                              int &selectedIndex, int &topIndex);
+
+// Goes up one level inside the archive, or out of it from its root.
+void handleArchiveBackAction(ArchiveBrowser &archive, std::string &currentPath,
+                             std::vector<FileEntry> &currentFiles,
+                             int &selectedIndex, int &topIndex);
+
+// Copies the selected archive member next to the archive.
+void handleExtractMemberAction(const ArchiveBrowser &archive,
+                               const std::vector<FileEntry> &currentFiles,
+                               int selectedIndex);
+
+// The rows whose names contain searchTerm, ignoring case, in ascending order.
+void findSearchMatches(const std::vector<FileEntry> &currentFiles,
+                       const std::string &searchTerm,
+                       std::vector<int> &matchIndices);
+
+bool handleSearchAction(std::vector<FileEntry> &currentFiles,
                         int &selectedIndex, int &topIndex,
                         std::string &searchTerm, std::vector<int> &matchIndices,
                         int &currentMatchIndex);
 
+// Moves to the first match after (direction 1) or before (-1) the cursor.
 void navigateToNextMatch(std::vector<int> &matchIndices, int &currentMatchIndex,
                          int &selectedIndex, int &topIndex, int direction);
 
@@ -40,7 +74,7 @@ void exitSearchMode(std::string &searchTerm, std::vector<int> &matchIndices,
 
 void handleCopyPathAction(
     const std::string &currentPath,
-    const std::vector<std::pair<std::string, bool>> &currentFiles,
+    const std::vector<FileEntry> &currentFiles,
     int selectedIndex);
 
 void addBookmark(const std::string &path);
@@ -48,5 +82,31 @@ bool removeBookmark(const std::string &path);
 std::vector<std::string> getBookmarks();
 bool handleBookmarkListAction(
     std::string &currentPath,
-    std::vector<std::pair<std::string, bool>> &currentFiles, int &selectedIndex,
+    std::vector<FileEntry> &currentFiles, int &selectedIndex,
     int &topIndex);
+
+// The views below run their own key loop on top of the main one: they wait
+// on loop for keys and for the background work to post its progress, and
+// run whatever else is posted meanwhile.
+
+// Prompts for a pattern and searches the contents of every file under
+// currentPath, listing hits as they are found. Returns true if the user
+// jumped to one of them.
+bool handleContentSearchAction(std::string &currentPath,
+                               std::vector<FileEntry> &currentFiles,
+                               int &selectedIndex, int &topIndex,
+                               EventLoop &loop);
+
+// Scans currentPath recursively for duplicate files and shows them grouped.
+// Returns true if the user jumped to one of them.
+bool handleDuplicatesAction(std::string &currentPath,
+                            std::vector<FileEntry> &currentFiles,
+                            int &selectedIndex, int &topIndex,
+                            EventLoop &loop);
+
+// Prompts for a second directory (a path or a bookmark number) and compares
+// the tree under currentPath against it side by side, listing entries found
+// on one side only or differing. Returns true if the user jumped to one.
+bool handleCompareAction(std::string &currentPath,
+                         std::vector<FileEntry> &currentFiles,
+                         int &selectedIndex, int &topIndex, EventLoop &loop);
@@ -0,0 +1,822 @@
+#include "archive.h"
+#include "safeio.h"
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <fcntl.h>
+#include <list>
+#include <mutex>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <tuple>
+#include <unistd.h>
+
+namespace {
+
+const size_t TAR_BLOCK = 512;
+const size_t COPY_CHUNK = 1 << 20;
+const size_t MAX_CACHED_ARCHIVES = 8;
+
+uint16_t readLE16(const unsigned char *p) { return p[0] | (p[1] << 8); }
+uint32_t readLE32(const unsigned char *p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) |
+         ((uint32_t)p[3] << 24);
+}
+uint64_t readLE64(const unsigned char *p) {
+  return (uint64_t)readLE32(p) | ((uint64_t)readLE32(p + 4) << 32);
+}
+
+bool readFully(int fd, void *buffer, size_t len, uint64_t offset) {
+  char *out = static_cast<char *>(buffer);
+  while (len > 0) {
+    ssize_t n = pread(fd, out, len, offset);
+    if (n <= 0)
+      return false;
+    out += n;
+    len -= n;
+    offset += n;
+  }
+  return true;
+}
+
+// Member paths are stored as "dir/name", without "./" or slashes at the ends
+std::string normalizeMemberPath(std::string path) {
+  while (path.compare(0, 2, "./") == 0)
+    path.erase(0, 2);
+  size_t start = path.find_first_not_of('/');
+  if (start == std::string::npos)
+    return "";
+  path.erase(0, start);
+  while (!path.empty() && path.back() == '/')
+    path.pop_back();
+  return path;
+}
+
+// Adds member (and any missing parent directories) to the index. A path
+// seen again replaces the earlier entry, as with tar's append semantics.
+void addMember(ArchiveIndex &index, ArchiveMember member) {
+  member.path = normalizeMemberPath(member.path);
+  if (member.path.empty() || member.path == "." || member.path == "..")
+    return;
+  auto existing = index.byPath.find(member.path);
+  if (existing != index.byPath.end()) {
+    index.members[existing->second] = std::move(member);
+    return;
+  }
+
+  size_t slash = member.path.rfind('/');
+  std::string parent = slash == std::string::npos
+                           ? std::string()
+                           : member.path.substr(0, slash);
+  if (!parent.empty() && !index.byPath.count(parent)) {
+    ArchiveMember dir;
+    dir.path = parent;
+    dir.isDir = true;
+    dir.mtime = member.mtime;
+    dir.mode = 0755;
+    dir.uid = member.uid;
+    dir.gid = member.gid;
+    addMember(index, std::move(dir));
+  }
+  size_t position = index.members.size();
+  index.byPath.emplace(member.path, position);
+  index.children[parent].push_back(position);
+  index.members.push_back(std::move(member));
+}
+
+} // namespace
+
+uint64_t parseTarNumber(const char *field, size_t len) {
+  const unsigned char *p = reinterpret_cast<const unsigned char *>(field);
+  uint64_t value = 0;
+  if (p[0] & 0x80) {
+    value = p[0] & 0x3f;
+    for (size_t i = 1; i < len; ++i)
+      value = (value << 8) | p[i];
+    return value;
+  }
+  size_t i = 0;
+  while (i < len && (p[i] == ' ' || p[i] == '\0'))
+    ++i;
+  for (; i < len && p[i] >= '0' && p[i] <= '7'; ++i)
+    value = value * 8 + (p[i] - '0');
+  return value;
+}
+
+namespace {
+
+bool isTarHeader(const unsigned char *block) {
+  uint64_t stored = parseTarNumber((const char *)block + 148, 8);
+  uint64_t sum = 0;
+  for (size_t i = 0; i < TAR_BLOCK; ++i)
+    sum += (i >= 148 && i < 156) ? ' ' : block[i];
+  return sum == stored;
+}
+
+std::string tarField(const unsigned char *block, size_t offset, size_t len) {
+  const char *start = (const char *)block + offset;
+  return std::string(start, strnlen(start, len));
+}
+
+// Applies path, size and mtime from a pax extended header's
+// "len key=value\n" records
+void parsePaxRecords(const std::string &data, std::string &path,
+                     uint64_t &size, bool &hasSize, time_t &mtime) {
+  size_t pos = 0;
+  while (pos < data.size()) {
+    size_t space = data.find(' ', pos);
+    if (space == std::string::npos)
+      break;
+    size_t recordLen = strtoull(data.c_str() + pos, nullptr, 10);
+    if (recordLen == 0 || pos + recordLen > data.size())
+      break;
+    size_t equals = data.find('=', space);
+    if (equals != std::string::npos && equals < pos + recordLen) {
+      std::string key = data.substr(space + 1, equals - space - 1);
+      std::string value =
+          data.substr(equals + 1, pos + recordLen - equals - 2); // Drop '\n'
+      if (key == "path") {
+        path = value;
+      } else if (key == "size") {
+        size = strtoull(value.c_str(), nullptr, 10);
+        hasSize = true;
+      } else if (key == "mtime") {
+        mtime = strtoll(value.c_str(), nullptr, 10);
+      }
+    }
+    pos += recordLen;
+  }
+}
+
+// Walks the tar headers, seeking over member data without reading it.
+bool indexTar(int fd, uint64_t fileSize, ArchiveIndex &index) {
+  unsigned char block[TAR_BLOCK];
+  uint64_t offset = 0;
+  std::string longName;
+  std::string paxPath;
+  uint64_t paxSize = 0;
+  bool paxHasSize = false;
+  time_t paxMtime = 0;
+  while (offset + TAR_BLOCK <= fileSize) {
+    noteIoProgress(); // Headers are spread over the whole file
+    if (!readFully(fd, block, TAR_BLOCK, offset))
+      return false;
+    if (block[0] == '\0')
+      break; // End-of-archive marker
+    if (!isTarHeader(block))
+      return !index.members.empty(); // Trailing garbage after a valid archive
+
+    uint64_t size = parseTarNumber((const char *)block + 124, 12);
+    if (paxHasSize)
+      size = paxSize;
+    char type = block[156];
+    uint64_t dataOffset = offset + TAR_BLOCK;
+    // A size running past the end of the file (truncated, or crafted so the
+    // next offset wraps around) ends the index at the members before it
+    if (size > fileSize - dataOffset)
+      return !index.members.empty();
+    uint64_t next = dataOffset + (size + TAR_BLOCK - 1) / TAR_BLOCK * TAR_BLOCK;
+    if (next <= offset)
+      return !index.members.empty();
+
+    if (type == 'L' || type == 'x') {
+      // Metadata for the next header: a GNU long name or pax records
+      std::string data(std::min<uint64_t>(size, 1 << 20), '\0');
+      if (!readFully(fd, &data[0], data.size(), dataOffset))
+        return false;
+      if (type == 'L')
+        longName = data.c_str();
+      else
+        parsePaxRecords(data, paxPath, paxSize, paxHasSize, paxMtime);
+      offset = next;
+      continue;
+    }
+
+    if (type == '0' || type == '\0' || type == '7' || type == '5' ||
+        type == '1' || type == '2') {
+      ArchiveMember member;
+      if (!paxPath.empty()) {
+        member.path = paxPath;
+      } else if (!longName.empty()) {
+        member.path = longName;
+      } else {
+        std::string prefix = tarField(block, 345, 155);
+        std::string name = tarField(block, 0, 100);
+        member.path = prefix.empty() ? name : prefix + "/" + name;
+      }
+      member.isDir = type == '5';
+      // Links have no data of their own
+      bool hasData = type != '5' && type != '1' && type != '2';
+      member.size = hasData ? size : 0;
+      member.packedSize = member.size;
+      member.mtime = paxMtime ? paxMtime
+                              : (time_t)parseTarNumber(
+                                    (const char *)block + 136, 12);
+      member.mode = parseTarNumber((const char *)block + 100, 8) & 07777;
+      member.uid = parseTarNumber((const char *)block + 108, 8);
+      member.gid = parseTarNumber((const char *)block + 116, 8);
+      member.offset = dataOffset;
+      addMember(index, std::move(member));
+    }
+    // Other types (devices, fifos, global pax headers) are skipped
+    longName.clear();
+    paxPath.clear();
+    paxHasSize = false;
+    paxMtime = 0;
+    offset = next;
+  }
+  return true;
+}
+
+time_t dosTime(uint16_t time, uint16_t date) {
+  std::tm tm = {};
+  tm.tm_sec = (time & 0x1f) * 2;
+  tm.tm_min = (time >> 5) & 0x3f;
+  tm.tm_hour = time >> 11;
+  tm.tm_mday = date & 0x1f;
+  tm.tm_mon = ((date >> 5) & 0x0f) - 1;
+  tm.tm_year = (date >> 9) + 80;
+  tm.tm_isdst = -1;
+  return mktime(&tm);
+}
+
+// Reads the central directory at the end of the file; the local headers are
+// only visited when a member is read.
+bool indexZip(int fd, uint64_t fileSize, ArchiveIndex &index) {
+  // The end-of-central-directory record is at most 64K (a comment) from the
+  // end
+  size_t tailLen = std::min<uint64_t>(fileSize, 22 + 65535);
+  std::vector<unsigned char> tail(tailLen);
+  if (!readFully(fd, tail.data(), tailLen, fileSize - tailLen))
+    return false;
+  size_t eocd = std::string::npos;
+  for (size_t i = tailLen >= 22 ? tailLen - 22 + 1 : 0; i-- > 0;) {
+    if (readLE32(&tail[i]) == 0x06054b50) {
+      eocd = i;
+      break;
+    }
+  }
+  if (eocd == std::string::npos)
+    return false;
+
+  uint64_t entries = readLE16(&tail[eocd + 10]);
+  uint64_t directorySize = readLE32(&tail[eocd + 12]);
+  uint64_t directoryOffset = readLE32(&tail[eocd + 16]);
+  if (entries == 0xffff || directorySize == 0xffffffff ||
+      directoryOffset == 0xffffffff) {
+    // Zip64: the locator just before the record points at the real values
+    unsigned char locator[20];
+    unsigned char record[56];
+    uint64_t locatorOffset = fileSize - tailLen + eocd - 20;
+    if (eocd + (fileSize - tailLen) < 20 ||
+        !readFully(fd, locator, sizeof(locator), locatorOffset) ||
+        readLE32(locator) != 0x07064b50 ||
+        !readFully(fd, record, sizeof(record), readLE64(locator + 8)) ||
+        readLE32(record) != 0x06064b50)
+      return false;
+    entries = readLE64(record + 32);
+    directorySize = readLE64(record + 40);
+    directoryOffset = readLE64(record + 48);
+  }
+  if (directoryOffset > fileSize || directorySize > fileSize - directoryOffset)
+    return false;
+
+  std::vector<unsigned char> directory(directorySize);
+  if (!readFully(fd, directory.data(), directorySize, directoryOffset))
+    return false;
+  size_t pos = 0;
+  for (uint64_t n = 0; n < entries && pos + 46 <= directorySize; ++n) {
+    const unsigned char *header = &directory[pos];
+    if (readLE32(header) != 0x02014b50)
+      return false;
+    uint16_t flags = readLE16(header + 8);
+    uint16_t method = readLE16(header + 10);
+    size_t nameLen = readLE16(header + 28);
+    size_t extraLen = readLE16(header + 30);
+    size_t commentLen = readLE16(header + 32);
+    if (pos + 46 + nameLen + extraLen > directorySize)
+      return false;
+
+    ArchiveMember member;
+    member.path.assign((const char *)header + 46, nameLen);
+    member.isDir = !member.path.empty() && member.path.back() == '/';
+    member.packedSize = readLE32(header + 20);
+    member.size = readLE32(header + 24);
+    member.offset = readLE32(header + 42);
+    member.mtime = dosTime(readLE16(header + 12), readLE16(header + 14));
+    member.inZip = true;
+    if (header[5] == 3) // Made on Unix: the high half holds st_mode
+      member.mode = (readLE32(header + 38) >> 16) & 07777;
+    member.deflated = method == 8;
+    member.readable = !(flags & 1) && (method == 0 || method == 8);
+
+    const unsigned char *extra = header + 46 + nameLen;
+    for (size_t e = 0; e + 4 <= extraLen;) {
+      uint16_t id = readLE16(extra + e);
+      uint16_t len = readLE16(extra + e + 2);
+      const unsigned char *field = extra + e + 4;
+      if (e + 4 + len > extraLen)
+        break;
+      if (id == 0x0001) {
+        // Zip64 sizes and offset, present only for the fields that overflowed
+        size_t f = 0;
+        if (member.size == 0xffffffff && f + 8 <= len) {
+          member.size = readLE64(field + f);
+          f += 8;
+        }
+        if (member.packedSize == 0xffffffff && f + 8 <= len) {
+          member.packedSize = readLE64(field + f);
+          f += 8;
+        }
+        if (member.offset == 0xffffffff && f + 8 <= len)
+          member.offset = readLE64(field + f);
+      } else if (id == 0x5455 && len >= 5 && (field[0] & 1)) {
+        member.mtime = (time_t)readLE32(field + 1); // UTC, unlike DOS time
+      }
+      e += 4 + len;
+    }
+    addMember(index, std::move(member));
+    pos += 46 + nameLen + extraLen + commentLen;
+  }
+  return true;
+}
+
+// Decoder for raw deflate streams (RFC 1951), after zlib's puff.c. Output is
+// passed to sink in pieces, keeping the last 32K for back-references.
+class Inflater {
+public:
+  Inflater(const unsigned char *input, size_t inputLen,
+           const std::function<bool(const char *, size_t)> &sink,
+           uint64_t maxOutput)
+      : in(input), inLen(inputLen), sink(sink), maxOutput(maxOutput) {}
+
+  bool run() {
+    bool last;
+    do {
+      last = bits(1);
+      int type = bits(2);
+      bool ok = type == 0   ? stored()
+                : type == 1 ? fixed()
+                : type == 2 ? dynamic()
+                            : false;
+      if (!ok || failed)
+        return false;
+    } while (!last && !done());
+    return flush(true);
+  }
+
+private:
+  static const int MAX_BITS = 15;
+  static const size_t WINDOW = 32768;
+
+  struct Huffman {
+    short count[MAX_BITS + 1];
+    short symbol[288];
+  };
+
+  const unsigned char *in;
+  size_t inLen;
+  size_t inPos = 0;
+  uint32_t bitBuffer = 0;
+  int bitCount = 0;
+  bool failed = false;
+  const std::function<bool(const char *, size_t)> &sink;
+  uint64_t maxOutput;
+  uint64_t flushed = 0;
+  std::string out;
+
+  bool done() const { return flushed + out.size() >= maxOutput; }
+
+  bool flush(bool all) {
+    size_t keep = all ? 0 : WINDOW;
+    if (out.size() <= keep)
+      return true;
+    size_t len = out.size() - keep;
+    if (flushed >= maxOutput)
+      len = 0;
+    else if (flushed + len > maxOutput)
+      len = maxOutput - flushed;
+    if (len > 0 && !sink(out.data(), len))
+      return false;
+    flushed += out.size() - keep;
+    out.erase(0, out.size() - keep);
+    return true;
+  }
+
+  int bits(int need) {
+    uint32_t value = bitBuffer;
+    while (bitCount < need) {
+      if (inPos == inLen) {
+        failed = true;
+        return 0;
+      }
+      value |= (uint32_t)in[inPos++] << bitCount;
+      bitCount += 8;
+    }
+    bitBuffer = value >> need;
+    bitCount -= need;
+    return value & ((1u << need) - 1);
+  }
+
+  bool stored() {
+    bitBuffer = 0;
+    bitCount = 0;
+    if (inPos + 4 > inLen)
+      return false;
+    unsigned len = in[inPos] | (in[inPos + 1] << 8);
+    unsigned check = in[inPos + 2] | (in[inPos + 3] << 8);
+    inPos += 4;
+    if (len != (~check & 0xffff) || inPos + len > inLen)
+      return false;
+    out.append((const char *)in + inPos, len);
+    inPos += len;
+    return flush(false);
+  }
+
+  static int build(Huffman &h, const short *length, int n) {
+    std::fill(h.count, h.count + MAX_BITS + 1, 0);
+    for (int symbol = 0; symbol < n; ++symbol)
+      h.count[length[symbol]]++;
+    if (h.count[0] == n)
+      return 0;
+    int left = 1;
+    for (int len = 1; len <= MAX_BITS; ++len) {
+      left <<= 1;
+      left -= h.count[len];
+      if (left < 0)
+        return left; // Over-subscribed
+    }
+    short offsets[MAX_BITS + 1];
+    offsets[1] = 0;
+    for (int len = 1; len < MAX_BITS; ++len)
+      offsets[len + 1] = offsets[len] + h.count[len];
+    for (int symbol = 0; symbol < n; ++symbol) {
+      if (length[symbol] != 0)
+        h.symbol[offsets[length[symbol]]++] = symbol;
+    }
+    return left;
+  }
+
+  int decode(const Huffman &h) {
+    int code = 0, first = 0, index = 0;
+    for (int len = 1; len <= MAX_BITS; ++len) {
+      code |= bits(1);
+      int count = h.count[len];
+      if (code - count < first)
+        return h.symbol[index + (code - first)];
+      index += count;
+      first += count;
+      first <<= 1;
+      code <<= 1;
+    }
+    failed = true;
+    return -1;
+  }
+
+  bool codes(const Huffman &lengthCode, const Huffman &distCode) {
+    static const short lengthBase[29] = {
+        3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+        31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+    static const short lengthExtra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1,
+                                          1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+                                          4, 4, 4, 4, 5, 5, 5, 5, 0};
+    static const int distBase[30] = {
+        1,    2,    3,    4,    5,    7,     9,     13,    17,  25,
+        33,   49,   65,   97,   129,  193,   257,   385,   513, 769,
+        1025, 1537, 2049, 3073, 4097, 6145,  8193,  12289, 16385, 24577};
+    static const short distExtra[30] = {0, 0, 0, 0, 1, 1, 2,  2,  3,  3,
+                                        4, 4, 5, 5, 6, 6, 7,  7,  8,  8,
+                                        9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+    while (true) {
+      int symbol = decode(lengthCode);
+      if (failed || symbol < 0)
+        return false;
+      if (symbol < 256) {
+        out.push_back((char)symbol);
+      } else if (symbol == 256) {
+        return true;
+      } else {
+        symbol -= 257;
+        if (symbol >= 29)
+          return false;
+        int len = lengthBase[symbol] + bits(lengthExtra[symbol]);
+        int distSymbol = decode(distCode);
+        if (failed || distSymbol < 0 || distSymbol >= 30)
+          return false;
+        size_t dist = distBase[distSymbol] + bits(distExtra[distSymbol]);
+        if (dist > out.size())
+          return false; // Also covers references before a flush
+        size_t from = out.size() - dist;
+        for (int i = 0; i < len; ++i)
+          out.push_back(out[from + i]);
+      }
+      if (out.size() >= WINDOW + COPY_CHUNK && !flush(false))
+        return false;
+      if (done())
+        return true;
+    }
+  }
+
+  bool fixed() {
+    static Huffman lengthCode, distCode;
+    static std::once_flag built;
+    std::call_once(built, []() {
+      short lengths[288];
+      int symbol = 0;
+      for (; symbol < 144; ++symbol)
+        lengths[symbol] = 8;
+      for (; symbol < 256; ++symbol)
+        lengths[symbol] = 9;
+      for (; symbol < 280; ++symbol)
+        lengths[symbol] = 7;
+      for (; symbol < 288; ++symbol)
+        lengths[symbol] = 8;
+      build(lengthCode, lengths, 288);
+      for (symbol = 0; symbol < 30; ++symbol)
+        lengths[symbol] = 5;
+      build(distCode, lengths, 30);
+    });
+    return codes(lengthCode, distCode);
+  }
+
+  bool dynamic() {
+    static const short order[19] = {16, 17, 18, 0, 8,  7, 9,  6, 10, 5,
+                                    11, 4,  12, 3, 13, 2, 14, 1, 15};
+    int lengthCount = bits(5) + 257;
+    int distCount = bits(5) + 1;
+    int codeCount = bits(4) + 4;
+    if (lengthCount > 286 || distCount > 30)
+      return false;
+
+    short lengths[320] = {0};
+    for (int i = 0; i < codeCount; ++i)
+      lengths[order[i]] = bits(3);
+    Huffman lengthCode, distCode;
+    if (build(lengthCode, lengths, 19) != 0)
+      return false;
+
+    int index = 0;
+    while (index < lengthCount + distCount) {
+      int symbol = decode(lengthCode);
+      if (failed || symbol < 0)
+        return false;
+      if (symbol < 16) {
+        lengths[index++] = symbol;
+        continue;
+      }
+      short repeat = 0;
+      int times;
+      if (symbol == 16) {
+        if (index == 0)
+          return false;
+        repeat = lengths[index - 1];
+        times = 3 + bits(2);
+      } else if (symbol == 17) {
+        times = 3 + bits(3);
+      } else {
+        times = 11 + bits(7);
+      }
+      if (index + times > lengthCount + distCount)
+        return false;
+      while (times--)
+        lengths[index++] = repeat;
+    }
+    if (lengths[256] == 0)
+      return false; // No end-of-block code
+    int err = build(lengthCode, lengths, lengthCount);
+    if (err < 0 || (err > 0 && lengthCount - lengthCode.count[0] != 1))
+      return false;
+    err = build(distCode, lengths + lengthCount, distCount);
+    if (err < 0 || (err > 0 && distCount - distCode.count[0] != 1))
+      return false;
+    return codes(lengthCode, distCode);
+  }
+};
+
+// Feeds up to maxBytes of member's contents to sink, in order.
+bool streamMember(const std::string &archivePath, const ArchiveMember &member,
+                  uint64_t maxBytes,
+                  const std::function<bool(const char *, size_t)> &sink) {
+  if (member.isDir || !member.readable)
+    return false;
+  int fd = open(archivePath.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+  struct stat st;
+  bool ok = fstat(fd, &st) == 0;
+
+  uint64_t dataOffset = member.offset;
+  if (ok && member.inZip) {
+    // Skip the local header, whose name and extra field can differ in length
+    // from the central directory's
+    unsigned char local[30];
+    ok = readFully(fd, local, 30, member.offset) &&
+         readLE32(local) == 0x04034b50;
+    dataOffset = member.offset + 30 + readLE16(local + 26) +
+                 readLE16(local + 28);
+  }
+  ok = ok && dataOffset <= (uint64_t)st.st_size &&
+       member.packedSize <= (uint64_t)st.st_size - dataOffset;
+
+  if (ok && !member.deflated) {
+    std::vector<char> chunk(std::min<uint64_t>(
+        COPY_CHUNK, std::max<uint64_t>(1, std::min(maxBytes, member.size))));
+    uint64_t remaining =
+        std::min({maxBytes, member.size, member.packedSize});
+    uint64_t offset = dataOffset;
+    while (ok && remaining > 0) {
+      size_t len = std::min<uint64_t>(remaining, chunk.size());
+      ok = readFully(fd, chunk.data(), len, offset) && sink(chunk.data(), len);
+      offset += len;
+      remaining -= len;
+    }
+  } else if (ok) {
+    void *mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapped == MAP_FAILED) {
+      ok = false;
+    } else {
+      madvise(mapped, st.st_size, MADV_SEQUENTIAL);
+      Inflater inflater(static_cast<const unsigned char *>(mapped) + dataOffset,
+                        member.packedSize, sink, maxBytes);
+      ok = inflater.run();
+      munmap(mapped, st.st_size);
+    }
+  }
+  close(fd);
+  return ok;
+}
+
+struct CachedIndex {
+  dev_t device;
+  ino_t inode;
+  off_t size;
+  time_t mtime;
+  std::shared_ptr<const ArchiveIndex> index;
+};
+
+std::mutex cacheMutex;
+std::list<CachedIndex> cache; // Most recently used first
+
+} // namespace
+
+std::shared_ptr<const ArchiveIndex> loadArchiveIndex(const std::string &path) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return nullptr;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+    close(fd);
+    return nullptr;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    for (auto it = cache.begin(); it != cache.end(); ++it) {
+      if (it->device == st.st_dev && it->inode == st.st_ino &&
+          it->size == st.st_size && it->mtime == st.st_mtime) {
+        cache.splice(cache.begin(), cache, it);
+        close(fd);
+        return cache.front().index;
+      }
+    }
+  }
+
+  auto index = std::make_shared<ArchiveIndex>();
+  unsigned char head[TAR_BLOCK] = {0};
+  bool ok = false;
+  if (st.st_size >= 4 &&
+      readFully(fd, head, std::min<off_t>(st.st_size, TAR_BLOCK), 0)) {
+    uint32_t magic = readLE32(head);
+    if (magic == 0x04034b50 || magic == 0x06054b50) {
+      index->format = ArchiveIndex::Format::Zip;
+      ok = indexZip(fd, st.st_size, *index);
+    } else if (st.st_size >= (off_t)TAR_BLOCK && isTarHeader(head)) {
+      index->format = ArchiveIndex::Format::Tar;
+      ok = indexTar(fd, st.st_size, *index);
+    }
+  }
+  close(fd);
+  if (!ok)
+    return nullptr;
+
+  std::lock_guard<std::mutex> lock(cacheMutex);
+  cache.push_front({st.st_dev, st.st_ino, st.st_size, st.st_mtime, index});
+  if (cache.size() > MAX_CACHED_ARCHIVES)
+    cache.pop_back();
+  return index;
+}
+
+bool readArchiveMember(const std::string &archivePath,
+                       const ArchiveMember &member, std::string &contents,
+                       size_t maxBytes) {
+  contents.clear();
+  return streamMember(archivePath, member, maxBytes,
+                      [&contents](const char *data, size_t len) {
+                        contents.append(data, len);
+                        return true;
+                      });
+}
+
+bool extractArchiveMember(const std::string &archivePath,
+                          const ArchiveMember &member,
+                          const std::string &destPath) {
+  int fd = open(destPath.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+  if (fd < 0)
+    return false;
+  bool ok = streamMember(archivePath, member, UINT64_MAX,
+                         [fd](const char *data, size_t len) {
+                           noteIoProgress();
+                           while (len > 0) {
+                             ssize_t n = write(fd, data, len);
+                             if (n <= 0)
+                               return false;
+                             data += n;
+                             len -= n;
+                           }
+                           return true;
+                         });
+  ok = close(fd) == 0 && ok;
+  if (!ok) {
+    unlink(destPath.c_str());
+    return false;
+  }
+  struct timeval times[2] = {{member.mtime, 0}, {member.mtime, 0}};
+  utimes(destPath.c_str(), times);
+  return true;
+}
+
+bool ArchiveBrowser::open(const std::string &path) {
+  auto loaded = std::make_shared<std::shared_ptr<const ArchiveIndex>>();
+  if (!runWithDeadline(path,
+                       [path, loaded]() { *loaded = loadArchiveIndex(path); }) ||
+      !*loaded)
+    return false;
+  index = std::move(*loaded);
+  archivePath = path;
+  innerPath.clear();
+  return true;
+}
+
+void ArchiveBrowser::close() {
+  index.reset();
+  archivePath.clear();
+  innerPath.clear();
+}
+
+std::string ArchiveBrowser::displayPath() const {
+  return innerPath.empty() ? archivePath : archivePath + "/" + innerPath;
+}
+
+std::vector<FileEntry> ArchiveBrowser::list(const std::string &innerDir) const {
+  std::vector<FileEntry> raw;
+  if (!index)
+    return raw;
+  auto children = index->children.find(innerDir);
+  if (children == index->children.end())
+    return raw;
+  raw.reserve(children->second.size());
+  for (size_t position : children->second) {
+    const ArchiveMember &member = index->members[position];
+    size_t slash = member.path.rfind('/');
+    raw.emplace_back(slash == std::string::npos ? member.path
+                                                : member.path.substr(slash + 1),
+                     member.isDir);
+    // Metadata comes from the headers; nothing here can be stat'd
+    EntryStat &meta = raw.back().meta;
+    meta.valid = true;
+    meta.mode = (member.isDir ? S_IFDIR : S_IFREG) |
+                (member.mode ? member.mode : member.isDir ? 0755 : 0644);
+    meta.uid = member.uid;
+    meta.gid = member.gid;
+    meta.links = 1;
+    meta.size = member.size;
+    meta.mtime = member.mtime;
+  }
+  return raw;
+}
+
+const ArchiveMember *ArchiveBrowser::find(const std::string &name) const {
+  if (!index)
+    return nullptr;
+  auto found =
+      index->byPath.find(innerPath.empty() ? name : innerPath + "/" + name);
+  return found == index->byPath.end() ? nullptr
+                                      : &index->members[found->second];
+}
+
+bool ArchiveBrowser::enter(const std::string &name) {
+  const ArchiveMember *member = find(name);
+  if (!member || !member->isDir)
+    return false;
+  innerPath = member->path;
+  return true;
+}
+
+bool ArchiveBrowser::leave() {
+  if (!index || innerPath.empty())
+    return false;
+  size_t slash = innerPath.rfind('/');
+  innerPath = slash == std::string::npos ? "" : innerPath.substr(0, slash);
+  return true;
+}
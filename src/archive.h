@@ -0,0 +1,91 @@
+#pragma once
+
+#include "utils.h"
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <string>
+#include <sys/types.h>
+#include <unordered_map>
+#include <vector>
+
+// One file or directory inside an archive. Directories that only appear as
+// a prefix of member paths get a synthetic entry.
+struct ArchiveMember {
+  std::string path; // Relative, without a trailing slash
+  bool isDir = false;
+  uint64_t size = 0;       // Uncompressed
+  uint64_t packedSize = 0; // As stored
+  time_t mtime = 0;
+  mode_t mode = 0; // Permission bits, when the archive records them
+  uid_t uid = 0;
+  gid_t gid = 0;
+  // Tar: start of the data. Zip: start of the local header, whose variable
+  // length fields are only read when the member is
+  uint64_t offset = 0;
+  bool inZip = false;
+  bool deflated = false;
+  bool readable = true; // False for encrypted or unsupported zip methods
+};
+
+// Headers of every member, read in one pass without extracting anything.
+struct ArchiveIndex {
+  enum class Format { Tar, Zip };
+  Format format = Format::Tar;
+  std::vector<ArchiveMember> members;
+  std::unordered_map<std::string, size_t> byPath;
+  // Directory path ("" for the root) -> indices of its direct children
+  std::unordered_map<std::string, std::vector<size_t>> children;
+};
+
+// Parses a tar header's numeric field: octal text (leading spaces or NULs
+// skipped), or big-endian binary when the high bit of the first byte is set
+// (the GNU extension for values that don't fit).
+uint64_t parseTarNumber(const char *field, size_t len);
+
+// Returns the index of the tar or zip archive at path, or null if it is
+// neither (detected from the contents, not the extension). Compressed
+// tarballs (.tar.gz, .tar.zst, ...) can't be seeked into and are not
+// supported. Indexes are cached in memory by device, inode, size and mtime,
+// so re-entering a large archive doesn't read it again.
+std::shared_ptr<const ArchiveIndex> loadArchiveIndex(const std::string &path);
+
+// Reads up to maxBytes of a member's contents, seeking straight to it.
+bool readArchiveMember(const std::string &archivePath,
+                       const ArchiveMember &member, std::string &contents,
+                       size_t maxBytes);
+// Writes a member's contents to destPath, which must not exist yet.
+bool extractArchiveMember(const std::string &archivePath,
+                          const ArchiveMember &member,
+                          const std::string &destPath);
+
+// The position of the browser inside an open archive, shown as a virtual
+// directory at archivePath/innerPath.
+class ArchiveBrowser {
+public:
+  // Opens path at its root if it is a supported archive. Reading the index
+  // runs under the I/O deadline (see safeio.h).
+  bool open(const std::string &path);
+  void close();
+  bool isOpen() const { return index != nullptr; }
+
+  const std::string &getArchivePath() const { return archivePath; }
+  const std::string &getInnerPath() const { return innerPath; }
+  // archivePath, plus /innerPath below the root
+  std::string displayPath() const;
+
+  // Raw listing of innerDir ("" for the root), as getDirectoryContents
+  // would return before filtering and sorting.
+  std::vector<FileEntry> list(const std::string &innerDir) const;
+  // Looks up name in the current directory.
+  const ArchiveMember *find(const std::string &name) const;
+  // Moves into the subdirectory name, or up one level. leave() returns
+  // false at the root.
+  bool enter(const std::string &name);
+  bool leave();
+
+private:
+  std::shared_ptr<const ArchiveIndex> index;
+  std::string archivePath;
+  std::string innerPath;
+};
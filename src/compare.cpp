@@ -0,0 +1,266 @@
+#include "compare.h"
+#include "utils.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <fcntl.h>
+#include <limits.h>
+#include <mutex>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+namespace {
+
+struct Listed {
+  std::string name;
+  struct stat st;
+  bool isLink;
+};
+
+std::string joinPath(const std::string &dir, const std::string &name) {
+  if (dir.empty() || name.empty())
+    return dir.empty() ? name : dir;
+  return dir == "/" ? dir + name : dir + "/" + name;
+}
+
+// Reads dirPath sorted by name (bytewise), so two listings merge in one pass.
+// Symlinks are listed as themselves, so dangling ones are compared too.
+void listSorted(const std::string &dirPath, const EntryMatcher *matcher,
+                const std::atomic<bool> &cancelled, std::vector<Listed> &out) {
+  scanDirectory(
+      dirPath,
+      [&out](const char *name, const struct stat &st, bool isLink) {
+        out.push_back({name, st, isLink});
+      },
+      matcher, &cancelled, false);
+  std::sort(out.begin(), out.end(), [](const Listed &a, const Listed &b) {
+    return a.name < b.name;
+  });
+}
+
+std::string linkTarget(const std::string &path) {
+  char target[PATH_MAX];
+  ssize_t len = readlink(path.c_str(), target, sizeof(target));
+  return len > 0 ? std::string(target, len) : std::string();
+}
+
+} // namespace
+
+bool comparePathLess(const std::string &a, const std::string &b) {
+  size_t len = std::min(a.size(), b.size());
+  for (size_t i = 0; i < len; ++i) {
+    unsigned char x = a[i] == '/' ? 0 : (unsigned char)a[i];
+    unsigned char y = b[i] == '/' ? 0 : (unsigned char)b[i];
+    if (x != y)
+      return x < y;
+  }
+  return a.size() < b.size();
+}
+
+struct TreeComparison::State {
+  std::string left;
+  std::string right;
+  CompareOptions options;
+  std::shared_ptr<const EntryMatcher> matcher;
+
+  std::atomic<bool> cancelled{false};
+  std::atomic<size_t> compared{0};
+  std::atomic<size_t> identical{0};
+  // Indexed by CompareStatus; counts past the entry limit too
+  std::atomic<size_t> byStatus[3] = {{0}, {0}, {0}};
+  std::atomic<bool> entryLimit{false};
+
+  std::mutex mutex;
+  std::condition_variable queued; // A pair was queued or the last one done
+  std::vector<std::string> pendingDirs; // Relative; depth-first
+  int busy = 0; // Workers comparing a pair right now
+  int workersRunning = 0;
+  size_t entryCount = 0;
+  std::vector<CompareEntry> entries; // Not yet taken
+  std::function<void()> ready;
+
+  void compareDirectory(const std::string &relDir,
+                        std::vector<std::string> &subdirs,
+                        std::vector<CompareEntry> &found);
+  void run();
+};
+
+void TreeComparison::State::compareDirectory(
+    const std::string &relDir, std::vector<std::string> &subdirs,
+    std::vector<CompareEntry> &found) {
+  std::vector<Listed> leftList, rightList;
+  listSorted(joinPath(left, relDir), matcher.get(), cancelled, leftList);
+  listSorted(joinPath(right, relDir), matcher.get(), cancelled, rightList);
+
+  size_t i = 0, j = 0;
+  while ((i < leftList.size() || j < rightList.size()) && !cancelled) {
+    int order = i == leftList.size()    ? 1
+                : j == rightList.size() ? -1
+                                        : leftList[i].name.compare(
+                                              rightList[j].name);
+    const Listed *l = order <= 0 ? &leftList[i++] : nullptr;
+    const Listed *r = order >= 0 ? &rightList[j++] : nullptr;
+    compared++;
+
+    CompareEntry entry;
+    entry.path = joinPath(relDir, (l ? l : r)->name);
+    if (l) {
+      entry.isDir = S_ISDIR(l->st.st_mode);
+      entry.leftSize = l->st.st_size;
+      entry.leftMtime = l->st.st_mtime;
+    }
+    if (r) {
+      entry.isDir = entry.isDir || S_ISDIR(r->st.st_mode);
+      entry.rightSize = r->st.st_size;
+      entry.rightMtime = r->st.st_mtime;
+    }
+    if (!r) {
+      entry.status = CompareStatus::OnlyLeft;
+      byStatus[(int)entry.status]++;
+      found.push_back(std::move(entry));
+      continue;
+    }
+    if (!l) {
+      entry.status = CompareStatus::OnlyRight;
+      byStatus[(int)entry.status]++;
+      found.push_back(std::move(entry));
+      continue;
+    }
+
+    entry.status = CompareStatus::Differs;
+    bool leftDir = S_ISDIR(l->st.st_mode), rightDir = S_ISDIR(r->st.st_mode);
+    if (l->isLink != r->isLink || leftDir != rightDir) {
+      entry.reason = DiffReason::Type;
+    } else if (l->isLink) {
+      if (linkTarget(joinPath(left, entry.path)) !=
+          linkTarget(joinPath(right, entry.path)))
+        entry.reason = DiffReason::LinkTarget;
+    } else if (leftDir) {
+      subdirs.push_back(entry.path);
+      continue;
+    } else if (l->st.st_size != r->st.st_size) {
+      entry.reason = DiffReason::Size;
+    } else if (options.compareContents) {
+      if (!sameFileContents(joinPath(left, entry.path),
+                        joinPath(right, entry.path), cancelled))
+        entry.reason = DiffReason::Content;
+    } else if (l->st.st_mtime != r->st.st_mtime) {
+      entry.reason = DiffReason::Time;
+    }
+    if (entry.reason == DiffReason::None) {
+      identical++;
+    } else {
+      byStatus[(int)entry.status]++;
+      found.push_back(std::move(entry));
+    }
+  }
+}
+
+void TreeComparison::State::run() {
+  std::vector<std::string> subdirs;
+  std::vector<CompareEntry> found;
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true) {
+    queued.wait(lock, [this]() {
+      return !pendingDirs.empty() || busy == 0 || cancelled;
+    });
+    if (cancelled || pendingDirs.empty())
+      break; // Nothing queued and nobody left to queue more
+    std::string relDir = std::move(pendingDirs.back());
+    pendingDirs.pop_back();
+    busy++;
+    lock.unlock();
+
+    subdirs.clear();
+    found.clear();
+    compareDirectory(relDir, subdirs, found);
+
+    lock.lock();
+    busy--;
+    // Reversed so the first subdirectory is compared next
+    pendingDirs.insert(pendingDirs.end(), subdirs.rbegin(), subdirs.rend());
+    size_t added = entries.size();
+    for (auto &entry : found) {
+      if (entryCount >= options.maxEntries) {
+        entryLimit = true;
+        break;
+      }
+      entries.push_back(std::move(entry));
+      entryCount++;
+    }
+    queued.notify_all();
+    if (entries.size() > added && ready) {
+      lock.unlock();
+      ready();
+      lock.lock();
+    }
+  }
+  // The last worker out finishes the comparison
+  bool finished = --workersRunning == 0;
+  queued.notify_all();
+  lock.unlock();
+  if (finished && ready)
+    ready();
+}
+
+void TreeComparison::start(const std::string &left, const std::string &right,
+                           const EntryMatcher *matcher,
+                           const CompareOptions &options,
+                           std::function<void()> ready) {
+  cancel();
+  auto comparison = std::make_shared<State>();
+  comparison->ready = std::move(ready);
+  comparison->left = left;
+  comparison->right = right;
+  comparison->options = options;
+  if (matcher)
+    comparison->matcher = std::make_shared<EntryMatcher>(*matcher);
+  comparison->pendingDirs.push_back("");
+
+  // Detached like the other background work, so cancelling never waits on
+  // a slow disk; each thread keeps the state alive
+  int workers = std::max(1u, std::thread::hardware_concurrency());
+  comparison->workersRunning = workers;
+  for (int i = 0; i < workers; ++i)
+    std::thread([comparison]() { comparison->run(); }).detach();
+  state = std::move(comparison);
+}
+
+void TreeComparison::cancel() {
+  if (!state)
+    return;
+  state->cancelled = true;
+  std::lock_guard<std::mutex> lock(state->mutex);
+  state->queued.notify_all();
+}
+
+bool TreeComparison::take(std::vector<CompareEntry> &entries) {
+  if (!state)
+    return false;
+  std::lock_guard<std::mutex> lock(state->mutex);
+  bool finished = state->workersRunning == 0;
+  if (state->entries.empty())
+    return !finished;
+  for (auto &entry : state->entries)
+    entries.push_back(std::move(entry));
+  state->entries.clear();
+  return true;
+}
+
+size_t TreeComparison::entriesCompared() const {
+  return state ? state->compared.load() : 0;
+}
+
+size_t TreeComparison::identical() const {
+  return state ? state->identical.load() : 0;
+}
+
+size_t TreeComparison::count(CompareStatus status) const {
+  return state ? state->byStatus[(int)status].load() : 0;
+}
+
+bool TreeComparison::reachedEntryLimit() const {
+  return state && state->entryLimit;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "filter.h"
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+enum class CompareStatus { OnlyLeft, OnlyRight, Differs };
+
+// Why two entries with the same path differ
+enum class DiffReason { None, Type, Size, Time, Content, LinkTarget };
+
+// A path under both roots that is missing on one side or differs. Identical
+// entries are only counted. A directory missing on one side is reported once,
+// without its contents.
+struct CompareEntry {
+  std::string path; // Relative to both roots
+  CompareStatus status;
+  DiffReason reason = DiffReason::None;
+  bool isDir = false; // On the side(s) that have it
+  uint64_t leftSize = 0, rightSize = 0;
+  time_t leftMtime = 0, rightMtime = 0;
+};
+
+struct CompareOptions {
+  // Decide files of equal size by their bytes instead of their mtimes
+  bool compareContents = false;
+  // Entries kept for the view; the walk keeps counting past this many
+  size_t maxEntries = 200000;
+};
+
+// Orders relative paths so each directory's contents follow it directly:
+// '/' sorts before every other byte.
+bool comparePathLess(const std::string &a, const std::string &b);
+
+// Compares two trees in the background. Directory pairs are handed to one
+// worker per core; each reads both listings, sorts them by name and merges
+// them, queueing the subdirectories present on both sides. Only one
+// directory's listings are held per worker, so memory stays flat however
+// large the trees are. Symlinks, dangling or not, are compared by target,
+// never followed.
+class TreeComparison {
+public:
+  // ready is called on a worker thread whenever entries are added and once
+  // the comparison has finished.
+  void start(const std::string &left, const std::string &right,
+             const EntryMatcher *matcher, const CompareOptions &options,
+             std::function<void()> ready = nullptr);
+  // Stops the workers without waiting for them.
+  void cancel();
+  ~TreeComparison() { cancel(); }
+
+  // Appends entries found since the last call, in no particular order.
+  // Returns false once the comparison has finished and every entry has been
+  // taken.
+  bool take(std::vector<CompareEntry> &entries);
+
+  size_t entriesCompared() const;
+  size_t identical() const;
+  // Entries found with status so far, including any past the entry limit
+  size_t count(CompareStatus status) const;
+  bool reachedEntryLimit() const;
+
+private:
+  struct State;
+  std::shared_ptr<State> state;
+};
@@ -0,0 +1,252 @@
+#include "dircache.h"
+#include "utils.h"
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace {
+
+const char kIndexMagic[4] = {'P', 'K', 'I', 'X'};
+const uint32_t kIndexVersion = 1;
+
+// On-disk layout: header, the directory path, `count` fixed-size records,
+// then a blob holding all names back to back.
+struct IndexHeader {
+  char magic[4];
+  uint32_t version;
+  int64_t dirMtimeSec;
+  int64_t dirMtimeNsec;
+  uint32_t count;
+  uint32_t pathLen;
+  uint64_t namesLen;
+};
+
+struct IndexRecord {
+  uint32_t nameOffset;
+  uint32_t nameLen;
+  uint32_t mode;
+  uint32_t reserved;
+  int64_t size;
+  int64_t mtime;
+};
+
+struct timespec statMtime(const struct stat &st) {
+#ifdef __APPLE__
+  return st.st_mtimespec;
+#else
+  return st.st_mtim;
+#endif
+}
+
+std::string getIndexDirectory() {
+  const char *xdg = getenv("XDG_CACHE_HOME");
+  std::string base;
+  if (xdg && *xdg) {
+    base = xdg;
+  } else {
+    base = getenv("HOME") ? getenv("HOME") : ".";
+    base += "/.cache";
+  }
+  return base + "/peek/index";
+}
+
+bool ensureDirectory(const std::string &path) {
+  size_t pos = 1;
+  while ((pos = path.find('/', pos)) != std::string::npos) {
+    mkdir(path.substr(0, pos).c_str(), 0755);
+    ++pos;
+  }
+  return mkdir(path.c_str(), 0755) == 0 || errno == EEXIST;
+}
+
+// FNV-1a is plenty to spread paths over file names; the full path is stored
+// in the index and compared on load to rule out collisions.
+std::string getIndexFilePath(const std::string &path) {
+  uint64_t hash = 1469598103934665603ULL;
+  for (unsigned char c : path) {
+    hash ^= c;
+    hash *= 1099511628211ULL;
+  }
+  char name[32];
+  snprintf(name, sizeof(name), "/%016llx.idx", (unsigned long long)hash);
+  return getIndexDirectory() + name;
+}
+
+bool writeIndexFile(const std::string &path, const struct stat &dirSt,
+                    const std::vector<std::pair<std::string, struct stat>>
+                        &scanned) {
+  if (!ensureDirectory(getIndexDirectory()))
+    return false;
+
+  IndexHeader header;
+  memcpy(header.magic, kIndexMagic, sizeof(header.magic));
+  header.version = kIndexVersion;
+  struct timespec mtime = statMtime(dirSt);
+  header.dirMtimeSec = mtime.tv_sec;
+  header.dirMtimeNsec = mtime.tv_nsec;
+  header.count = scanned.size();
+  header.pathLen = path.size();
+
+  std::vector<IndexRecord> records;
+  records.reserve(scanned.size());
+  std::string names;
+  for (const auto &entry : scanned) {
+    IndexRecord record;
+    record.nameOffset = names.size();
+    record.nameLen = entry.first.size();
+    record.mode = entry.second.st_mode;
+    record.reserved = 0;
+    record.size = entry.second.st_size;
+    record.mtime = entry.second.st_mtime;
+    records.push_back(record);
+    names += entry.first;
+  }
+  header.namesLen = names.size();
+
+  // Write to a temporary file and rename it into place so a concurrent
+  // reader never maps a half-written index.
+  std::string indexFile = getIndexFilePath(path);
+  std::string tmpFile = indexFile + ".tmp." + std::to_string(getpid());
+  FILE *file = fopen(tmpFile.c_str(), "wb");
+  if (!file)
+    return false;
+  bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+            fwrite(path.data(), 1, path.size(), file) == path.size() &&
+            (records.empty() ||
+             fwrite(records.data(), sizeof(IndexRecord), records.size(),
+                    file) == records.size()) &&
+            fwrite(names.data(), 1, names.size(), file) == names.size();
+  ok = (fclose(file) == 0) && ok;
+  if (!ok || rename(tmpFile.c_str(), indexFile.c_str()) != 0) {
+    unlink(tmpFile.c_str());
+    return false;
+  }
+  return true;
+}
+
+} // namespace
+
+bool loadDirectoryIndex(const std::string &path, DirectoryIndex &index) {
+  int fd = open(getIndexFilePath(path).c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(IndexHeader)) {
+    close(fd);
+    return false;
+  }
+  size_t fileSize = st.st_size;
+  void *map = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+    return false;
+
+  const char *base = static_cast<const char *>(map);
+  IndexHeader header;
+  memcpy(&header, base, sizeof(header));
+
+  // namesLen is a 64-bit field from the file: compare it against the space
+  // left rather than adding it to an offset, which a corrupt value can wrap
+  size_t recordsOffset = sizeof(header) + header.pathLen;
+  size_t namesOffset =
+      recordsOffset + (size_t)header.count * sizeof(IndexRecord);
+  bool ok = memcmp(header.magic, kIndexMagic, sizeof(header.magic)) == 0 &&
+            header.version == kIndexVersion && recordsOffset <= fileSize &&
+            namesOffset <= fileSize &&
+            header.namesLen == fileSize - namesOffset &&
+            header.pathLen == path.size() &&
+            memcmp(base + sizeof(header), path.data(), path.size()) == 0;
+
+  if (ok) {
+    const IndexRecord *records =
+        reinterpret_cast<const IndexRecord *>(base + recordsOffset);
+    const char *names = base + namesOffset;
+    index.entries.clear();
+    index.entries.reserve(header.count);
+    for (uint32_t i = 0; i < header.count; ++i) {
+      IndexRecord record;
+      memcpy(&record, &records[i], sizeof(record));
+      if ((uint64_t)record.nameOffset + record.nameLen > header.namesLen) {
+        ok = false;
+        break;
+      }
+      index.entries.emplace_back(
+          std::string(names + record.nameOffset, record.nameLen),
+          S_ISDIR(record.mode));
+    }
+    index.dirMtime.tv_sec = header.dirMtimeSec;
+    index.dirMtime.tv_nsec = header.dirMtimeNsec;
+  }
+
+  munmap(map, fileSize);
+  return ok;
+}
+
+bool rebuildDirectoryIndex(const std::string &path, DirectoryIndex &index) {
+  // Stat the directory before reading it: if it changes mid-scan the stored
+  // mtime is older than the real one and the next startup rescans.
+  struct stat dirSt;
+  if (stat(path.c_str(), &dirSt) != 0)
+    return false;
+
+  std::vector<std::pair<std::string, struct stat>> scanned;
+  index.entries.clear();
+  bool ok = scanDirectory(path, [&](const char *name, const struct stat &st,
+                                    bool isLink) {
+    scanned.emplace_back(name, st);
+    index.entries.emplace_back(name, st, isLink);
+  });
+
+  index.dirMtime = statMtime(dirSt);
+
+  if (ok)
+    writeIndexFile(path, dirSt, scanned);
+  return ok;
+}
+
+bool isDirectoryIndexStale(const std::string &path,
+                           const DirectoryIndex &index) {
+  struct stat dirSt;
+  if (stat(path.c_str(), &dirSt) != 0)
+    return true;
+  struct timespec mtime = statMtime(dirSt);
+  return mtime.tv_sec != index.dirMtime.tv_sec ||
+         mtime.tv_nsec != index.dirMtime.tv_nsec;
+}
+
+void patchDirectoryListing(
+    std::vector<FileEntry> &currentFiles,
+    const std::vector<FileEntry> &freshFiles) {
+  std::unordered_map<std::string, const FileEntry *> fresh;
+  fresh.reserve(freshFiles.size());
+  for (const auto &entry : freshFiles)
+    fresh.emplace(entry.name, &entry);
+
+  std::vector<FileEntry> patched;
+  patched.reserve(freshFiles.size());
+  std::unordered_set<std::string> kept;
+  for (const auto &entry : currentFiles) {
+    auto it = fresh.find(entry.name);
+    if (it != fresh.end()) {
+      patched.push_back(*it->second); // Fresh type and metadata
+      kept.insert(entry.name);
+    }
+  }
+  for (const auto &entry : freshFiles) {
+    if (kept.find(entry.name) == kept.end())
+      patched.push_back(entry);
+  }
+  currentFiles.swap(patched);
+}
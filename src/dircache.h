@@ -0,0 +1,34 @@
+#pragma once
+
+#include "utils.h"
+#include <string>
+#include <sys/stat.h>
+#include <utility>
+#include <vector>
+
+// Persistent per-directory listing index stored under ~/.cache/peek/index.
+// Each index is a single binary file that is mmap'd on load, so a cached
+// listing can be rendered without touching the (possibly slow) directory.
+struct DirectoryIndex {
+  std::vector<FileEntry> entries;
+  struct timespec dirMtime = {0, 0};
+};
+
+// Reads the cached listing for path. Returns false if there is no usable
+// index (missing, corrupt, or written for a different path).
+bool loadDirectoryIndex(const std::string &path, DirectoryIndex &index);
+
+// Scans path and rewrites its index. Returns false if the directory could not
+// be read; the fresh listing is stored in index either way.
+bool rebuildDirectoryIndex(const std::string &path, DirectoryIndex &index);
+
+// True if the directory's mtime no longer matches the cached index, meaning
+// entries were added, removed or renamed since it was written.
+bool isDirectoryIndexStale(const std::string &path,
+                           const DirectoryIndex &index);
+
+// Applies a fresh listing to the one on screen: entries that still exist keep
+// their position, removed ones are dropped and new ones are appended.
+void patchDirectoryListing(
+    std::vector<FileEntry> &currentFiles,
+    const std::vector<FileEntry> &freshFiles);
@@ -0,0 +1,317 @@
+#include "duplicates.h"
+#include "utils.h"
+#include "walk.h"
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <set>
+#include <sys/stat.h>
+#include <tuple>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// Bytes hashed at each end of a file in the partial-hash stage
+const size_t PARTIAL_BLOCK = 4096;
+const size_t READ_CHUNK = 1 << 20;
+
+// Streaming 64-bit hash with the xxHash64 construction: four independent
+// multiply-rotate lanes over 32-byte stripes, which keeps every ALU busy and
+// auto-vectorizes, then a merge and avalanche. Only compared within one run,
+// so the host byte order is fine.
+class ContentHasher {
+public:
+  explicit ContentHasher(uint64_t seed = 0)
+      : lanes{seed + P1 + P2, seed + P2, seed, seed - P1}, seed(seed) {}
+
+  void update(const void *data, size_t len) {
+    const unsigned char *p = static_cast<const unsigned char *>(data);
+    const unsigned char *end = p + len;
+    totalLen += len;
+    if (bufferedLen + len < sizeof(buffer)) {
+      memcpy(buffer + bufferedLen, p, len);
+      bufferedLen += len;
+      return;
+    }
+    if (bufferedLen > 0) {
+      size_t fill = sizeof(buffer) - bufferedLen;
+      memcpy(buffer + bufferedLen, p, fill);
+      stripe(buffer);
+      p += fill;
+      bufferedLen = 0;
+    }
+    for (; p + sizeof(buffer) <= end; p += sizeof(buffer))
+      stripe(p);
+    bufferedLen = end - p;
+    memcpy(buffer, p, bufferedLen);
+  }
+
+  uint64_t digest() const {
+    uint64_t h;
+    if (totalLen >= sizeof(buffer)) {
+      h = rotl(lanes[0], 1) + rotl(lanes[1], 7) + rotl(lanes[2], 12) +
+          rotl(lanes[3], 18);
+      for (uint64_t lane : lanes) {
+        h ^= round(0, lane);
+        h = h * P1 + P4;
+      }
+    } else {
+      h = seed + P5;
+    }
+    h += totalLen;
+
+    const unsigned char *p = buffer;
+    const unsigned char *end = buffer + bufferedLen;
+    for (; p + 8 <= end; p += 8) {
+      h ^= round(0, read64(p));
+      h = rotl(h, 27) * P1 + P4;
+    }
+    if (p + 4 <= end) {
+      uint32_t word;
+      memcpy(&word, p, 4);
+      h ^= word * P1;
+      h = rotl(h, 23) * P2 + P3;
+      p += 4;
+    }
+    for (; p < end; ++p) {
+      h ^= *p * P5;
+      h = rotl(h, 11) * P1;
+    }
+    h ^= h >> 33;
+    h *= P2;
+    h ^= h >> 29;
+    h *= P3;
+    h ^= h >> 32;
+    return h;
+  }
+
+private:
+  static constexpr uint64_t P1 = 0x9E3779B185EBCA87ULL;
+  static constexpr uint64_t P2 = 0xC2B2AE3D27D4EB4FULL;
+  static constexpr uint64_t P3 = 0x165667B19E3779F9ULL;
+  static constexpr uint64_t P4 = 0x85EBCA77C2B2AE63ULL;
+  static constexpr uint64_t P5 = 0x27D4EB2F165667C5ULL;
+
+  static uint64_t rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+  static uint64_t read64(const unsigned char *p) {
+    uint64_t value;
+    memcpy(&value, p, 8);
+    return value;
+  }
+  static uint64_t round(uint64_t acc, uint64_t input) {
+    acc += input * P2;
+    return rotl(acc, 31) * P1;
+  }
+
+  void stripe(const unsigned char *p) {
+    for (int i = 0; i < 4; ++i)
+      lanes[i] = round(lanes[i], read64(p + i * 8));
+  }
+
+  uint64_t lanes[4];
+  uint64_t seed;
+  uint64_t totalLen = 0;
+  unsigned char buffer[32];
+  size_t bufferedLen = 0;
+};
+
+struct Candidate {
+  std::string path;
+  uint64_t size;
+  uint64_t hash = 0; // Partial, then full
+  bool readable = true;
+};
+
+// Hashes the first and last PARTIAL_BLOCK bytes, which for small files is
+// the whole file.
+bool hashEnds(const Candidate &file, uint64_t &hash) {
+  int fd = open(file.path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+  unsigned char block[2 * PARTIAL_BLOCK];
+  size_t len;
+  bool ok;
+  if (file.size <= sizeof(block)) {
+    len = file.size;
+    ok = pread(fd, block, len, 0) == (ssize_t)len;
+  } else {
+    len = sizeof(block);
+    ok = pread(fd, block, PARTIAL_BLOCK, 0) == (ssize_t)PARTIAL_BLOCK &&
+         pread(fd, block + PARTIAL_BLOCK, PARTIAL_BLOCK,
+               file.size - PARTIAL_BLOCK) == (ssize_t)PARTIAL_BLOCK;
+  }
+  close(fd);
+  if (!ok)
+    return false;
+  ContentHasher hasher;
+  hasher.update(block, len);
+  hash = hasher.digest();
+  return true;
+}
+
+// Read rather than mapped: a file that shrank since the walk would fault on
+// the pages past its new end. A size change means it is no longer a
+// candidate.
+bool hashContents(const Candidate &file, const std::atomic<bool> &cancelled,
+                  uint64_t &hash) {
+  int fd = open(file.path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+  ContentHasher hasher;
+  struct stat st;
+  bool ok = fstat(fd, &st) == 0 && (uint64_t)st.st_size == file.size;
+  std::vector<unsigned char> chunk(READ_CHUNK);
+  uint64_t total = 0;
+  ssize_t n;
+  while (ok && (n = read(fd, chunk.data(), chunk.size())) > 0) {
+    hasher.update(chunk.data(), n);
+    total += n;
+    ok = !cancelled;
+  }
+  ok = ok && total == file.size;
+  close(fd);
+  hash = hasher.digest();
+  return ok;
+}
+
+// Splits a run of files that agree on size and hash into the sets that are
+// really byte-for-byte identical, keeping those of two or more. A hash match
+// alone is not enough to offer deleting one of them.
+void splitByContents(std::vector<Candidate> &run,
+                     const std::atomic<bool> &cancelled,
+                     std::vector<std::vector<Candidate>> &identical) {
+  std::vector<std::vector<Candidate>> sets;
+  for (auto &file : run) {
+    bool placed = false;
+    for (auto &set : sets) {
+      if (sameFileContents(set.front().path, file.path, cancelled)) {
+        set.push_back(std::move(file));
+        placed = true;
+        break;
+      }
+    }
+    if (!placed && !cancelled) {
+      sets.emplace_back();
+      sets.back().push_back(std::move(file));
+    }
+  }
+  for (auto &set : sets) {
+    if (set.size() >= 2)
+      identical.push_back(std::move(set));
+  }
+}
+
+// Sorts files by (size, hash) and keeps only runs of two or more readable
+// files that agree on both.
+void keepMatchingRuns(std::vector<Candidate> &files) {
+  std::sort(files.begin(), files.end(),
+            [](const Candidate &a, const Candidate &b) {
+              return std::tie(a.size, a.hash) < std::tie(b.size, b.hash);
+            });
+  std::vector<Candidate> kept;
+  for (size_t start = 0; start < files.size();) {
+    size_t end = start;
+    size_t readable = 0;
+    while (end < files.size() && files[end].size == files[start].size &&
+           files[end].hash == files[start].hash) {
+      readable += files[end].readable;
+      ++end;
+    }
+    if (readable >= 2) {
+      for (size_t i = start; i < end; ++i) {
+        if (files[i].readable)
+          kept.push_back(std::move(files[i]));
+      }
+    }
+    start = end;
+  }
+  files = std::move(kept);
+}
+
+} // namespace
+
+std::vector<DuplicateGroup> findDuplicates(const std::string &root,
+                                           const EntryMatcher *matcher,
+                                           DuplicateScanProgress &progress) {
+  // Stage 1: sizes come free with the walk's lstat
+  std::vector<Candidate> files;
+  std::set<std::pair<dev_t, ino_t>> inodes;
+  bool complete = walkTree(
+      root, matcher,
+      [&](const std::string &path, const struct stat &st) {
+        progress.filesSeen++;
+        if (st.st_size > 0 && inodes.emplace(st.st_dev, st.st_ino).second)
+          files.push_back({path, (uint64_t)st.st_size});
+      },
+      &progress.cancelled);
+  if (!complete)
+    return {};
+  keepMatchingRuns(files);
+
+  // Stage 2: first and last blocks
+  runParallel(files.size(), [&](size_t i) {
+    if (!progress.cancelled)
+      files[i].readable = hashEnds(files[i], files[i].hash);
+    progress.filesHashed++;
+  });
+  if (progress.cancelled)
+    return {};
+  keepMatchingRuns(files);
+
+  // Stage 3: full contents, for files the partial hash didn't fully cover.
+  // Biggest first so one huge file doesn't finish alone at the end.
+  std::vector<size_t> order(files.size());
+  for (size_t i = 0; i < order.size(); ++i)
+    order[i] = i;
+  std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return files[a].size > files[b].size;
+  });
+  runParallel(order.size(), [&](size_t n) {
+    Candidate &file = files[order[n]];
+    if (!progress.cancelled && file.size > 2 * PARTIAL_BLOCK) {
+      uint64_t hash = 0;
+      file.readable = hashContents(file, progress.cancelled, hash);
+      file.hash = hash;
+    }
+    progress.filesHashed++;
+  });
+  if (progress.cancelled)
+    return {};
+  keepMatchingRuns(files);
+
+  // Stage 4: byte-for-byte comparison within each run, one run per task
+  std::vector<std::vector<Candidate>> runs;
+  for (size_t i = 0; i < files.size(); ++i) {
+    if (i == 0 || files[i].size != files[i - 1].size ||
+        files[i].hash != files[i - 1].hash)
+      runs.emplace_back();
+    runs.back().push_back(std::move(files[i]));
+  }
+  std::vector<std::vector<std::vector<Candidate>>> verified(runs.size());
+  runParallel(runs.size(), [&](size_t i) {
+    if (!progress.cancelled)
+      splitByContents(runs[i], progress.cancelled, verified[i]);
+  });
+  if (progress.cancelled)
+    return {};
+
+  std::vector<DuplicateGroup> groups;
+  for (auto &sets : verified) {
+    for (auto &set : sets) {
+      groups.emplace_back();
+      groups.back().size = set.front().size;
+      for (auto &file : set)
+        groups.back().paths.push_back(std::move(file.path));
+    }
+  }
+  for (auto &group : groups)
+    std::sort(group.paths.begin(), group.paths.end());
+  std::stable_sort(groups.begin(), groups.end(),
+                   [](const DuplicateGroup &a, const DuplicateGroup &b) {
+                     return a.size * (a.paths.size() - 1) >
+                            b.size * (b.paths.size() - 1);
+                   });
+  return groups;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "filter.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Files under one root with identical contents.
+struct DuplicateGroup {
+  uint64_t size = 0;
+  std::vector<std::string> paths;
+};
+
+struct DuplicateScanProgress {
+  std::atomic<size_t> filesSeen{0};
+  std::atomic<size_t> filesHashed{0};
+  std::atomic<bool> cancelled{false};
+};
+
+// Finds duplicate regular files under root in stages, each run only on the
+// survivors of the previous one: files are grouped by size, then by a hash
+// of their first and last blocks, then by a hash of their full contents, and
+// finally compared byte for byte, so a hash collision never makes a group.
+// Hashing and comparing are spread across all cores. Groups come back with the most
+// reclaimable space first. Empty files and extra hard links to the
+// same inode are ignored, since deleting them frees nothing.
+std::vector<DuplicateGroup> findDuplicates(const std::string &root,
+                                           const EntryMatcher *matcher,
+                                           DuplicateScanProgress &progress);
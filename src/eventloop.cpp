@@ -0,0 +1,173 @@
+#include "eventloop.h"
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <iterator>
+#include <poll.h>
+#include <string>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#elif defined(__APPLE__)
+#include <sys/event.h>
+#endif
+
+struct EventLoop::Poster::Shared {
+  MpscQueue<std::function<void()>> queue;
+  std::atomic<bool> wakePending{false};
+  int wakeRead = -1;
+  int wakeWrite = -1;
+
+  ~Shared() {
+    if (wakeRead >= 0)
+      close(wakeRead);
+    if (wakeWrite >= 0)
+      close(wakeWrite);
+  }
+};
+
+void EventLoop::Poster::post(std::function<void()> task) const {
+  if (!shared)
+    return;
+  shared->queue.push(std::move(task));
+  // One byte in the pipe is enough to wake the loop, however many posts
+  // land before it drains
+  if (!shared->wakePending.exchange(true)) {
+    char byte = 1;
+    ssize_t written = write(shared->wakeWrite, &byte, 1);
+    (void)written;
+  }
+}
+
+EventLoop::EventLoop() {
+  posterHandle.shared = std::make_shared<Poster::Shared>();
+  int fds[2];
+  if (pipe(fds) == 0) {
+    for (int fd : fds) {
+      fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+      fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+    posterHandle.shared->wakeRead = fds[0];
+    posterHandle.shared->wakeWrite = fds[1];
+  }
+#ifdef __linux__
+  watchFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#elif defined(__APPLE__)
+  watchFd = kqueue();
+#endif
+}
+
+EventLoop::~EventLoop() {
+  watchDirectories({});
+  if (watchFd >= 0)
+    close(watchFd);
+}
+
+void EventLoop::drain() {
+  Poster::Shared &shared = *posterHandle.shared;
+  char buffer[64];
+  while (read(shared.wakeRead, buffer, sizeof(buffer)) > 0) {
+  }
+  shared.wakePending = false;
+  shared.queue.drain([](std::function<void()> &task) { task(); });
+}
+
+void EventLoop::unwatch(int handle) {
+#ifdef __linux__
+  inotify_rm_watch(watchFd, handle);
+#elif defined(__APPLE__)
+  close(handle); // Closing the descriptor removes its kevent
+#endif
+  watches.erase(handle);
+}
+
+void EventLoop::watchDirectories(const std::vector<std::string> &paths) {
+  if (watchFd < 0)
+    return;
+  for (auto it = watches.begin(); it != watches.end();) {
+    auto next = std::next(it);
+    if (std::find(paths.begin(), paths.end(), it->second) == paths.end())
+      unwatch(it->first);
+    it = next;
+  }
+  for (const std::string &path : paths) {
+    bool watched = std::any_of(watches.begin(), watches.end(),
+                               [&](const std::pair<const int, std::string> &w) {
+                                 return w.second == path;
+                               });
+    if (path.empty() || watched)
+      continue;
+#ifdef __linux__
+    int handle = inotify_add_watch(
+        watchFd, path.c_str(),
+        IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB |
+            IN_CLOSE_WRITE | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR);
+#elif defined(__APPLE__)
+    int handle = open(path.c_str(), O_EVTONLY);
+    if (handle >= 0) {
+      struct kevent change;
+      EV_SET(&change, handle, EVFILT_VNODE, EV_ADD | EV_CLEAR,
+             NOTE_WRITE | NOTE_DELETE | NOTE_RENAME | NOTE_ATTRIB, 0,
+             nullptr);
+      kevent(watchFd, &change, 1, nullptr, 0, nullptr);
+    }
+#else
+    int handle = -1;
+#endif
+    if (handle >= 0)
+      watches[handle] = path;
+  }
+}
+
+int EventLoop::wait(int timeoutMs) {
+  struct pollfd fds[3];
+  int count = 0;
+  fds[count++] = {STDIN_FILENO, POLLIN, 0};
+  fds[count++] = {posterHandle.shared->wakeRead, POLLIN, 0};
+  if (watchFd >= 0 && !watches.empty())
+    fds[count++] = {watchFd, POLLIN, 0};
+
+  int ready = poll(fds, count, timeoutMs);
+  if (ready <= 0)
+    return WAKE_TIMEOUT; // Includes EINTR from SIGWINCH; the caller redraws
+
+  int reasons = WAKE_TIMEOUT;
+  if (fds[0].revents & (POLLIN | POLLHUP | POLLERR))
+    reasons |= WAKE_INPUT;
+  if (fds[1].revents & POLLIN)
+    reasons |= WAKE_POSTED;
+  if (count > 2 && (fds[2].revents & POLLIN)) {
+    // Swallow the whole burst; the caller rereads each directory once
+    size_t before = changed.size();
+    auto noteChanged = [this](int handle) {
+      auto watch = watches.find(handle);
+      if (watch != watches.end() &&
+          std::find(changed.begin(), changed.end(), watch->second) ==
+              changed.end())
+        changed.push_back(watch->second);
+    };
+#ifdef __linux__
+    alignas(struct inotify_event) char buffer[4096];
+    ssize_t len;
+    while ((len = read(watchFd, buffer, sizeof(buffer))) > 0) {
+      for (ssize_t pos = 0; pos < len;) {
+        const auto *event =
+            reinterpret_cast<const struct inotify_event *>(buffer + pos);
+        noteChanged(event->wd);
+        pos += sizeof(struct inotify_event) + event->len;
+      }
+    }
+#elif defined(__APPLE__)
+    struct kevent events[16];
+    struct timespec zero = {0, 0};
+    int n;
+    while ((n = kevent(watchFd, nullptr, 0, events, 16, &zero)) > 0) {
+      for (int i = 0; i < n; ++i)
+        noteChanged((int)events[i].ident);
+    }
+#endif
+    if (changed.size() > before)
+      reasons |= WAKE_DIR_CHANGED;
+  }
+  return reasons;
+}
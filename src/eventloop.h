@@ -0,0 +1,119 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Lock-free multi-producer, single-consumer queue. Producers push with a CAS
+// onto an intrusive stack; the consumer takes the whole stack in one exchange
+// and reverses it back into FIFO order.
+template <typename T> class MpscQueue {
+public:
+  MpscQueue() = default;
+  ~MpscQueue() {
+    Node *node = head.exchange(nullptr);
+    while (node) {
+      Node *next = node->next;
+      delete node;
+      node = next;
+    }
+  }
+  MpscQueue(const MpscQueue &) = delete;
+  MpscQueue &operator=(const MpscQueue &) = delete;
+
+  void push(T value) {
+    Node *node = new Node{std::move(value), head.load(std::memory_order_relaxed)};
+    while (!head.compare_exchange_weak(node->next, node,
+                                       std::memory_order_release,
+                                       std::memory_order_relaxed)) {
+    }
+  }
+
+  // Calls consume(value) for everything pushed so far, oldest first.
+  template <typename F> void drain(F consume) {
+    Node *node = head.exchange(nullptr, std::memory_order_acquire);
+    Node *reversed = nullptr;
+    while (node) {
+      Node *next = node->next;
+      node->next = reversed;
+      reversed = node;
+      node = next;
+    }
+    while (reversed) {
+      Node *next = reversed->next;
+      consume(reversed->value);
+      delete reversed;
+      reversed = next;
+    }
+  }
+
+private:
+  struct Node {
+    T value;
+    Node *next;
+  };
+  std::atomic<Node *> head{nullptr};
+};
+
+// The main loop's single blocking point. Waits with poll(2) on stdin, a
+// self-pipe that worker threads write to after posting a completion, and
+// directory watches (inotify on Linux, kqueue on macOS). Timers are deadlines
+// the caller folds into the wait timeout.
+class EventLoop {
+public:
+  enum WakeReason {
+    WAKE_TIMEOUT = 0,
+    WAKE_INPUT = 1 << 0,
+    WAKE_POSTED = 1 << 1,
+    WAKE_DIR_CHANGED = 1 << 2,
+  };
+
+  // Copyable handle for worker threads. Stays valid after the loop is gone;
+  // posts made then are dropped.
+  class Poster {
+  public:
+    void post(std::function<void()> task) const;
+
+  private:
+    friend class EventLoop;
+    struct Shared;
+    std::shared_ptr<Shared> shared;
+  };
+
+  EventLoop();
+  ~EventLoop();
+  EventLoop(const EventLoop &) = delete;
+  EventLoop &operator=(const EventLoop &) = delete;
+
+  Poster poster() const { return posterHandle; }
+  void post(std::function<void()> task) const { posterHandle.post(task); }
+
+  // Runs every posted task on the calling (main) thread. Call once per frame.
+  void drain();
+
+  // Replaces the set of watched directories (one per visible pane); only
+  // the ones that changed are added or removed.
+  void watchDirectories(const std::vector<std::string> &paths);
+
+  // Blocks until something happens or timeoutMs passes (-1 waits forever).
+  // Returns a mask of WakeReason bits.
+  int wait(int timeoutMs);
+
+  // The watched directories that changed since the last call. Changes seen
+  // by a wait in a modal view are kept for the main loop.
+  std::vector<std::string> takeChangedDirectories() {
+    return std::move(changed);
+  }
+
+private:
+  void unwatch(int handle);
+
+  Poster posterHandle;
+  int watchFd = -1;
+  // Watch descriptor (inotify) or open directory (kqueue) -> path
+  std::map<int, std::string> watches;
+  std::vector<std::string> changed;
+};
@@ -0,0 +1,189 @@
+#include "filter.h"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <fnmatch.h>
+#include <string>
+#include <vector>
+
+namespace {
+
+std::string lowerCopy(std::string s) {
+  std::transform(s.begin(), s.end(), s.begin(),
+                 [](unsigned char c) { return std::tolower(c); });
+  return s;
+}
+
+void splitList(const std::string &value, std::vector<std::string> &out) {
+  size_t start = 0;
+  while (start <= value.size()) {
+    size_t comma = value.find(',', start);
+    std::string item = value.substr(start, comma - start);
+    if (!item.empty() && item[0] == '.')
+      item.erase(0, 1);
+    if (!item.empty())
+      out.push_back(item);
+    if (comma == std::string::npos)
+      break;
+    start = comma + 1;
+  }
+}
+
+} // namespace
+
+std::string FilterSpec::describe() const {
+  std::string text;
+  auto add = [&text](const std::string &part) {
+    if (!text.empty())
+      text += ", ";
+    text += part;
+  };
+  if (hideHidden)
+    add("no hidden");
+  if (type == TypeFilter::DirsOnly)
+    add("dirs only");
+  else if (type == TypeFilter::FilesOnly)
+    add("files only");
+  for (const auto &glob : includeGlobs)
+    add(glob);
+  for (const auto &glob : excludeGlobs)
+    add("!" + glob);
+  if (!extensions.empty()) {
+    std::string exts;
+    for (const auto &ext : extensions)
+      exts += (exts.empty() ? "." : ",.") + ext;
+    add(exts);
+  }
+  return text;
+}
+
+EntryMatcher::EntryMatcher(const FilterSpec &spec)
+    : isEmpty(spec.empty()), hideHidden(spec.hideHidden),
+      typeFilter(spec.type) {
+  for (const auto &glob : spec.includeGlobs)
+    includes.push_back(compileGlob(glob));
+  for (const auto &glob : spec.excludeGlobs)
+    excludes.push_back(compileGlob(glob));
+  for (const auto &ext : spec.extensions)
+    extensions.insert(lowerCopy(ext));
+}
+
+// Most globs people type are "*.ext", "prefix*" or a plain name; those are
+// compared directly and only the rest go through fnmatch.
+EntryMatcher::Glob EntryMatcher::compileGlob(const std::string &glob) {
+  const char *specials = "*?[\\";
+  size_t firstSpecial = glob.find_first_of(specials);
+  if (firstSpecial == std::string::npos)
+    return {GlobKind::Literal, glob};
+  if (firstSpecial == 0 && glob[0] == '*' &&
+      glob.find_first_of(specials, 1) == std::string::npos)
+    return {GlobKind::Suffix, glob.substr(1)};
+  if (firstSpecial == glob.size() - 1 && glob.back() == '*')
+    return {GlobKind::Prefix, glob.substr(0, glob.size() - 1)};
+  return {GlobKind::Pattern, glob};
+}
+
+bool EntryMatcher::matchGlob(const Glob &glob, const char *name, size_t len) {
+  const std::string &text = glob.text;
+  switch (glob.kind) {
+  case GlobKind::Literal:
+    return len == text.size() && memcmp(name, text.data(), len) == 0;
+  case GlobKind::Prefix:
+    return len >= text.size() && memcmp(name, text.data(), text.size()) == 0;
+  case GlobKind::Suffix:
+    return len >= text.size() &&
+           memcmp(name + len - text.size(), text.data(), text.size()) == 0;
+  case GlobKind::Pattern:
+    return fnmatch(text.c_str(), name, 0) == 0;
+  }
+  return false;
+}
+
+bool EntryMatcher::matchesName(const char *name) const {
+  if (isEmpty)
+    return true;
+  if (hideHidden && name[0] == '.')
+    return false;
+  if (!excludes.empty()) {
+    size_t len = strlen(name);
+    for (const auto &glob : excludes) {
+      if (matchGlob(glob, name, len))
+        return false;
+    }
+  }
+  return true;
+}
+
+bool EntryMatcher::matchesTyped(const char *name, bool isDir) const {
+  if (isEmpty)
+    return true;
+  if (typeFilter == TypeFilter::DirsOnly && !isDir)
+    return false;
+  if (typeFilter == TypeFilter::FilesOnly && isDir)
+    return false;
+  // Include globs and extensions narrow the files; directories stay visible
+  // so the tree can still be navigated
+  if (isDir)
+    return true;
+  size_t len = strlen(name);
+  if (!includes.empty()) {
+    bool included = false;
+    for (const auto &glob : includes) {
+      if (matchGlob(glob, name, len)) {
+        included = true;
+        break;
+      }
+    }
+    if (!included)
+      return false;
+  }
+  if (!extensions.empty()) {
+    const char *dot = strrchr(name, '.');
+    if (!dot || dot == name || dot[1] == '\0' ||
+        extensions.find(lowerCopy(dot + 1)) == extensions.end())
+      return false;
+  }
+  return true;
+}
+
+int parseFilterOption(int argc, char *argv[], int &i, FilterSpec &spec) {
+  std::string arg = argv[i];
+  std::string value;
+  bool hasValue = false;
+  size_t eq = arg.find('=');
+  if (arg.compare(0, 2, "--") == 0 && eq != std::string::npos) {
+    value = arg.substr(eq + 1);
+    arg = arg.substr(0, eq);
+    hasValue = true;
+  }
+
+  if (arg == "-H" || arg == "--no-hidden") {
+    spec.hideHidden = true;
+    return 1;
+  }
+  if (arg == "-d" || arg == "--dirs") {
+    spec.type = TypeFilter::DirsOnly;
+    return 1;
+  }
+  if (arg == "-f" || arg == "--files") {
+    spec.type = TypeFilter::FilesOnly;
+    return 1;
+  }
+  if (arg != "-I" && arg != "--include" && arg != "-X" &&
+      arg != "--exclude" && arg != "-e" && arg != "--ext")
+    return 0;
+
+  if (!hasValue) {
+    if (i + 1 >= argc)
+      return -1;
+    value = argv[++i];
+  }
+  if (arg == "-I" || arg == "--include") {
+    spec.includeGlobs.push_back(value);
+  } else if (arg == "-X" || arg == "--exclude") {
+    spec.excludeGlobs.push_back(value);
+  } else {
+    splitList(value, spec.extensions);
+  }
+  return 1;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+enum class TypeFilter { All, DirsOnly, FilesOnly };
+
+// User-facing description of which entries to show.
+struct FilterSpec {
+  bool hideHidden = false;
+  TypeFilter type = TypeFilter::All;
+  std::vector<std::string> includeGlobs; // Files must match one of these
+  std::vector<std::string> excludeGlobs; // Entries matching any are dropped
+  std::vector<std::string> extensions;   // Files must have one of these
+
+  bool empty() const {
+    return !hideHidden && type == TypeFilter::All && includeGlobs.empty() &&
+           excludeGlobs.empty() && extensions.empty();
+  }
+  bool operator==(const FilterSpec &other) const {
+    return hideHidden == other.hideHidden && type == other.type &&
+           includeGlobs == other.includeGlobs &&
+           excludeGlobs == other.excludeGlobs &&
+           extensions == other.extensions;
+  }
+  bool operator!=(const FilterSpec &other) const { return !(*this == other); }
+  std::string describe() const;
+};
+
+// A FilterSpec compiled for fast per-entry checks. Name checks run before an
+// entry is stat'd, so excluded entries cost only the readdir.
+class EntryMatcher {
+public:
+  EntryMatcher() = default;
+  explicit EntryMatcher(const FilterSpec &spec);
+
+  bool empty() const { return isEmpty; }
+  bool filtersByType() const { return typeFilter != TypeFilter::All; }
+
+  // Checks that don't depend on the entry type (hidden, exclude globs)
+  bool matchesName(const char *name) const;
+  // Checks that need to know whether the entry is a directory
+  bool matchesTyped(const char *name, bool isDir) const;
+  bool matches(const char *name, bool isDir) const {
+    return matchesName(name) && matchesTyped(name, isDir);
+  }
+
+private:
+  enum class GlobKind { Literal, Prefix, Suffix, Pattern };
+  struct Glob {
+    GlobKind kind;
+    std::string text; // Literal/prefix/suffix text, or the fnmatch pattern
+  };
+
+  static Glob compileGlob(const std::string &glob);
+  static bool matchGlob(const Glob &glob, const char *name, size_t len);
+
+  bool isEmpty = true;
+  bool hideHidden = false;
+  TypeFilter typeFilter = TypeFilter::All;
+  std::vector<Glob> includes;
+  std::vector<Glob> excludes;
+  std::unordered_set<std::string> extensions; // Lowercase, without the dot
+};
+
+// Parses a filter option shared by the browser and `peek --list`
+// (--no-hidden, --dirs, --files, --include, --exclude, --ext) at argv[i].
+// Returns 1 if consumed (advancing i past any value), 0 if argv[i] is not a
+// filter option, and -1 if its value is missing.
+int parseFilterOption(int argc, char *argv[], int &i, FilterSpec &spec);
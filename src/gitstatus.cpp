@@ -0,0 +1,518 @@
+#include "gitstatus.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace {
+
+struct GitIgnoreRule {
+  std::string base; // Directory of the .gitignore, relative to the root
+  std::string pattern;
+  bool negate;
+  bool dirOnly;
+  bool anchored;
+};
+
+struct SubtreeVerdict {
+  bool dirty;
+  size_t modifiedEntry; // Index of the entry found modified, if dirty
+};
+
+// Everything we know about one repository for a given .git/index version.
+struct GitRepo {
+  std::string root;
+  struct timespec indexMtime = {0, 0};
+  off_t indexSize = 0;
+  std::vector<GitIndexEntry> entries; // Sorted by path, like the index
+  std::vector<GitIgnoreRule> excludes; // From .git/info/exclude
+
+  // Subtree verdicts for directories, so revisiting a directory in a huge
+  // repository doesn't re-stat every tracked file below it. A dirty verdict
+  // keeps the modified entry that proved it, which is re-stat'd on each
+  // visit. Editing a tracked file changes the work tree without touching the
+  // index, so clean verdicts are also dropped when a watch reports a change
+  // in the directory or below it (see invalidateGitStatus).
+  std::mutex verdictMutex;
+  std::unordered_map<std::string, SubtreeVerdict> subtreeVerdicts;
+  uint64_t forgetCount = 0; // A walk racing a change must not store clean
+};
+
+std::mutex repoCacheMutex;
+std::unordered_map<std::string, std::shared_ptr<GitRepo>> repoCache;
+
+uint32_t readBE32(const unsigned char *p) {
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+         ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+uint16_t readBE16(const unsigned char *p) {
+  return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+struct timespec statMtime(const struct stat &st) {
+#ifdef __APPLE__
+  return st.st_mtimespec;
+#else
+  return st.st_mtim;
+#endif
+}
+
+// Finds the work tree root containing dirPath and the git directory that
+// holds its index. Handles `.git` files pointing elsewhere (worktrees,
+// submodules).
+bool findRepository(const std::string &dirPath, std::string &root,
+                    std::string &gitDir) {
+  std::string path = dirPath;
+  while (true) {
+    std::string candidate = (path == "/" ? "" : path) + "/.git";
+    struct stat st;
+    if (stat(candidate.c_str(), &st) == 0) {
+      if (S_ISDIR(st.st_mode)) {
+        root = path;
+        gitDir = candidate;
+        return true;
+      }
+      std::ifstream file(candidate);
+      std::string line;
+      if (std::getline(file, line) && line.compare(0, 8, "gitdir: ") == 0) {
+        gitDir = line.substr(8);
+        if (!gitDir.empty() && gitDir[0] != '/')
+          gitDir = path + "/" + gitDir;
+        root = path;
+        return true;
+      }
+    }
+    if (path == "/" || path.empty())
+      return false;
+    size_t lastSlash = path.find_last_of('/');
+    path = lastSlash == 0 ? "/" : path.substr(0, lastSlash);
+  }
+}
+
+} // namespace
+
+bool parseGitIndex(const unsigned char *data, size_t size,
+                   std::vector<GitIndexEntry> &entries) {
+  if (size < 12 || memcmp(data, "DIRC", 4) != 0)
+    return false;
+  uint32_t version = readBE32(data + 4);
+  if (version < 2 || version > 4)
+    return false;
+  uint32_t count = readBE32(data + 8);
+
+  const unsigned char *p = data + 12;
+  const unsigned char *end = data + size;
+  std::string previousPath;
+  entries.reserve(count);
+  for (uint32_t i = 0; i < count; ++i) {
+    const unsigned char *entryStart = p;
+    if (end - p < 62)
+      return false;
+    GitIndexEntry entry;
+    entry.mtimeSec = readBE32(p + 8);
+    entry.mtimeNsec = readBE32(p + 12);
+    entry.ino = readBE32(p + 20);
+    entry.mode = readBE32(p + 24);
+    entry.size = readBE32(p + 36);
+    uint16_t flags = readBE16(p + 60);
+    entry.conflicted = ((flags >> 12) & 0x3) != 0;
+    p += 62;
+    if (version >= 3 && (flags & 0x4000))
+      p += 2; // Extended flags
+
+    if (version == 4) {
+      // Path is stored as "strip N bytes from the previous path" + suffix
+      uint64_t strip = 0;
+      if (p >= end)
+        return false;
+      unsigned char c = *p++;
+      strip = c & 0x7f;
+      while (c & 0x80) {
+        if (p >= end)
+          return false;
+        c = *p++;
+        strip = ((strip + 1) << 7) | (c & 0x7f);
+      }
+      const unsigned char *nul =
+          static_cast<const unsigned char *>(memchr(p, 0, end - p));
+      if (!nul || strip > previousPath.size())
+        return false;
+      entry.path = previousPath.substr(0, previousPath.size() - strip);
+      entry.path.append(reinterpret_cast<const char *>(p), nul - p);
+      p = nul + 1;
+    } else {
+      const unsigned char *nul =
+          static_cast<const unsigned char *>(memchr(p, 0, end - p));
+      if (!nul)
+        return false;
+      entry.path.assign(reinterpret_cast<const char *>(p), nul - p);
+      // Entries are NUL-padded to a multiple of 8 bytes
+      size_t entryLen = (nul - entryStart) + 1;
+      p = entryStart + ((entryLen + 7) & ~(size_t)7);
+      if (p > end)
+        return false;
+    }
+    previousPath = entry.path;
+    entries.push_back(std::move(entry));
+  }
+  return true;
+}
+
+namespace {
+
+void loadIgnoreFile(const std::string &file, const std::string &base,
+                    std::vector<GitIgnoreRule> &rules) {
+  std::ifstream in(file);
+  std::string line;
+  while (std::getline(in, line)) {
+    while (!line.empty() && (line.back() == '\r' || line.back() == ' '))
+      line.pop_back();
+    if (line.empty() || line[0] == '#')
+      continue;
+    GitIgnoreRule rule;
+    rule.base = base;
+    rule.negate = line[0] == '!';
+    if (rule.negate)
+      line.erase(0, 1);
+    rule.dirOnly = !line.empty() && line.back() == '/';
+    if (rule.dirOnly)
+      line.pop_back();
+    rule.anchored = line.find('/') != std::string::npos;
+    if (!line.empty() && line[0] == '/')
+      line.erase(0, 1);
+    if (line.empty())
+      continue;
+    rule.pattern = line;
+    rules.push_back(std::move(rule));
+  }
+}
+
+// Returns +1 if ignored, -1 if explicitly re-included, 0 if no rule matched.
+int matchIgnoreRules(const std::vector<GitIgnoreRule> &rules,
+                     const std::string &relPath, bool isDir) {
+  int verdict = 0;
+  for (const auto &rule : rules) {
+    if (rule.dirOnly && !isDir)
+      continue;
+    std::string subject;
+    if (!rule.base.empty()) {
+      if (relPath.compare(0, rule.base.size() + 1, rule.base + "/") != 0)
+        continue;
+      subject = relPath.substr(rule.base.size() + 1);
+    } else {
+      subject = relPath;
+    }
+    bool matched;
+    if (rule.anchored) {
+      // FNM_PATHNAME would stop `**` from crossing directories
+      int flags = rule.pattern.find("**") != std::string::npos ? 0
+                                                               : FNM_PATHNAME;
+      matched = fnmatch(rule.pattern.c_str(), subject.c_str(), flags) == 0;
+    } else {
+      size_t slash = subject.find_last_of('/');
+      const char *name =
+          subject.c_str() + (slash == std::string::npos ? 0 : slash + 1);
+      matched = fnmatch(rule.pattern.c_str(), name, 0) == 0;
+    }
+    if (matched)
+      verdict = rule.negate ? -1 : 1;
+  }
+  return verdict;
+}
+
+std::shared_ptr<GitRepo> getRepository(const std::string &root,
+                                       const std::string &gitDir) {
+  std::string indexPath = gitDir + "/index";
+  struct stat st;
+  bool hasIndex = stat(indexPath.c_str(), &st) == 0;
+  struct timespec mtime = hasIndex ? statMtime(st) : timespec{0, 0};
+  off_t size = hasIndex ? st.st_size : 0;
+
+  {
+    std::lock_guard<std::mutex> lock(repoCacheMutex);
+    auto it = repoCache.find(root);
+    if (it != repoCache.end() && it->second->indexSize == size &&
+        it->second->indexMtime.tv_sec == mtime.tv_sec &&
+        it->second->indexMtime.tv_nsec == mtime.tv_nsec) {
+      return it->second;
+    }
+  }
+
+  auto repo = std::make_shared<GitRepo>();
+  repo->root = root;
+  repo->indexMtime = mtime;
+  repo->indexSize = size;
+  if (hasIndex && size > 0) {
+    int fd = open(indexPath.c_str(), O_RDONLY);
+    if (fd >= 0) {
+      void *map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+      close(fd);
+      if (map != MAP_FAILED) {
+        if (!parseGitIndex(static_cast<const unsigned char *>(map), size,
+                           repo->entries)) {
+          repo->entries.clear();
+        }
+        munmap(map, size);
+      }
+    }
+  }
+  loadIgnoreFile(gitDir + "/info/exclude", "", repo->excludes);
+
+  std::lock_guard<std::mutex> lock(repoCacheMutex);
+  repoCache[root] = repo;
+  return repo;
+}
+
+bool isEntryModified(const GitRepo &repo, const GitIndexEntry &entry) {
+  if (entry.conflicted)
+    return true;
+  std::string fullPath = repo.root + "/" + entry.path;
+  struct stat st;
+  if (lstat(fullPath.c_str(), &st) != 0)
+    return true; // Deleted from the work tree
+  struct timespec mtime = statMtime(st);
+  if ((uint32_t)mtime.tv_sec != entry.mtimeSec ||
+      (entry.mtimeNsec != 0 && (uint32_t)mtime.tv_nsec != entry.mtimeNsec))
+    return true;
+  return (uint32_t)st.st_size != entry.size ||
+         (entry.ino != 0 && (uint32_t)st.st_ino != entry.ino);
+}
+
+// Drops the clean verdicts of relDir and every directory above it, which a
+// modified file in relDir makes wrong.
+void forgetCleanVerdicts(GitRepo &repo, std::string relDir) {
+  std::lock_guard<std::mutex> lock(repo.verdictMutex);
+  repo.forgetCount++;
+  while (!relDir.empty()) {
+    auto it = repo.subtreeVerdicts.find(relDir);
+    if (it != repo.subtreeVerdicts.end() && !it->second.dirty)
+      repo.subtreeVerdicts.erase(it);
+    size_t slash = relDir.rfind('/');
+    relDir.erase(slash == std::string::npos ? 0 : slash);
+  }
+}
+
+// Returns the marks for listing, or stops early once cancelled is set (the
+// partial result is then not to be used).
+GitDirStatus computeGitStatus(const std::string &dirPath,
+                              const std::vector<FileEntry> &listing,
+                              const std::atomic<bool> &cancelled) {
+  GitDirStatus result;
+  result.dirPath = dirPath;
+
+  std::string root, gitDir;
+  if (!findRepository(dirPath, root, gitDir))
+    return result;
+  std::shared_ptr<GitRepo> repo = getRepository(root, gitDir);
+  result.inRepo = true;
+
+  std::string relDir =
+      dirPath.size() > root.size() ? dirPath.substr(root.size() + 1) : "";
+  // Skip .git itself and anything inside it
+  if (relDir == ".git" || relDir.compare(0, 5, ".git/") == 0)
+    return result;
+
+  // Collect .gitignore rules from the root down to this directory
+  std::vector<GitIgnoreRule> rules = repo->excludes;
+  loadIgnoreFile(root + "/.gitignore", "", rules);
+  bool parentIgnored = false;
+  size_t pos = 0;
+  while (!relDir.empty() && pos != std::string::npos) {
+    size_t next = relDir.find('/', pos);
+    std::string prefix = relDir.substr(0, next);
+    if (matchIgnoreRules(rules, prefix, true) > 0)
+      parentIgnored = true;
+    loadIgnoreFile(root + "/" + prefix + "/.gitignore", prefix, rules);
+    pos = next == std::string::npos ? next : next + 1;
+  }
+
+  const auto &entries = repo->entries;
+  auto byPath = [](const GitIndexEntry &e, const std::string &path) {
+    return e.path < path;
+  };
+
+  bool anyModified = false;
+  for (const auto &item : listing) {
+    if (cancelled)
+      return result;
+    const std::string &name = item.name;
+    if (name == ".git")
+      continue;
+    std::string relPath = relDir.empty() ? name : relDir + "/" + name;
+    GitFileStatus status = GitFileStatus::Clean;
+
+    if (!item.isDir) {
+      auto it = std::lower_bound(entries.begin(), entries.end(), relPath,
+                                 byPath);
+      if (it != entries.end() && it->path == relPath) {
+        if (isEntryModified(*repo, *it))
+          status = GitFileStatus::Modified;
+      } else if (parentIgnored ||
+                 matchIgnoreRules(rules, relPath, false) > 0) {
+        status = GitFileStatus::Ignored;
+      } else {
+        status = GitFileStatus::Untracked;
+      }
+    } else {
+      std::string prefix = relPath + "/";
+      auto first = std::lower_bound(entries.begin(), entries.end(), prefix,
+                                    byPath);
+      bool tracked = first != entries.end() &&
+                     first->path.compare(0, prefix.size(), prefix) == 0;
+      if (!tracked) {
+        status = (parentIgnored || matchIgnoreRules(rules, relPath, true) > 0)
+                     ? GitFileStatus::Ignored
+                     : GitFileStatus::Untracked;
+      } else {
+        bool known = false;
+        bool dirty = false;
+        SubtreeVerdict verdict = {false, 0};
+        uint64_t forgetCount;
+        {
+          std::lock_guard<std::mutex> lock(repo->verdictMutex);
+          forgetCount = repo->forgetCount;
+          auto it = repo->subtreeVerdicts.find(relPath);
+          if (it != repo->subtreeVerdicts.end()) {
+            verdict = it->second;
+            known = true;
+          }
+        }
+        if (known && verdict.dirty) {
+          // Still dirty while the file that proved it is; else walk again
+          dirty = isEntryModified(*repo, entries[verdict.modifiedEntry]);
+          known = dirty;
+        }
+        if (!known) {
+          verdict = {false, 0};
+          for (auto it = first;
+               it != entries.end() &&
+               it->path.compare(0, prefix.size(), prefix) == 0;
+               ++it) {
+            if (cancelled)
+              return result;
+            if (isEntryModified(*repo, *it)) {
+              verdict = {true, (size_t)(it - entries.begin())};
+              break;
+            }
+          }
+          dirty = verdict.dirty;
+          std::lock_guard<std::mutex> lock(repo->verdictMutex);
+          if (dirty || repo->forgetCount == forgetCount)
+            repo->subtreeVerdicts[relPath] = verdict;
+        }
+        if (dirty)
+          status = GitFileStatus::Modified;
+      }
+    }
+
+    if (status == GitFileStatus::Modified)
+      anyModified = true;
+    if (status != GitFileStatus::Clean)
+      result.statuses.emplace(name, status);
+  }
+  if (anyModified)
+    forgetCleanVerdicts(*repo, relDir);
+  return result;
+}
+
+struct GitStatusRequest {
+  const void *owner;
+  std::string dirPath;
+  std::vector<FileEntry> entries;
+  std::function<void(GitDirStatus)> done;
+};
+
+// The one thread computing statuses. At most one request per owner waits;
+// a newer one replaces it, and abandons the owner's request being computed.
+struct GitStatusWorker {
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::deque<GitStatusRequest> pending;
+  const void *runningOwner = nullptr;
+  std::atomic<bool> cancelRunning{false};
+
+  void run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+      wake.wait(lock, [this] { return !pending.empty(); });
+      GitStatusRequest request = std::move(pending.front());
+      pending.pop_front();
+      runningOwner = request.owner;
+      cancelRunning = false;
+      lock.unlock();
+
+      GitDirStatus result =
+          computeGitStatus(request.dirPath, request.entries, cancelRunning);
+      if (!cancelRunning)
+        request.done(std::move(result));
+
+      lock.lock();
+      runningOwner = nullptr;
+    }
+  }
+};
+
+GitStatusWorker &gitStatusWorker() {
+  // Never destroyed: the detached thread may still be walking a huge
+  // repository when peek exits, and must never make quitting wait
+  static GitStatusWorker *worker = [] {
+    auto *created = new GitStatusWorker();
+    std::thread([created]() { created->run(); }).detach();
+    return created;
+  }();
+  return *worker;
+}
+
+} // namespace
+
+void requestGitStatus(const void *owner, const std::string &dirPath,
+                      const std::vector<FileEntry> &entries,
+                      std::function<void(GitDirStatus)> done) {
+  GitStatusWorker &worker = gitStatusWorker();
+  std::lock_guard<std::mutex> lock(worker.mutex);
+  if (worker.runningOwner == owner)
+    worker.cancelRunning = true;
+  auto replaced =
+      std::find_if(worker.pending.begin(), worker.pending.end(),
+                   [owner](const GitStatusRequest &waiting) {
+                     return waiting.owner == owner;
+                   });
+  GitStatusRequest request = {owner, dirPath, entries, std::move(done)};
+  if (replaced != worker.pending.end())
+    *replaced = std::move(request);
+  else
+    worker.pending.push_back(std::move(request));
+  worker.wake.notify_one();
+}
+
+void invalidateGitStatus(const std::string &dirPath) {
+  std::vector<std::shared_ptr<GitRepo>> repos;
+  {
+    std::lock_guard<std::mutex> lock(repoCacheMutex);
+    for (const auto &cached : repoCache)
+      repos.push_back(cached.second);
+  }
+  for (const auto &repo : repos) {
+    const std::string &root = repo->root;
+    if (dirPath.size() > root.size() &&
+        dirPath.compare(0, root.size(), root) == 0 &&
+        dirPath[root.size()] == '/')
+      forgetCleanVerdicts(*repo, dirPath.substr(root.size() + 1));
+  }
+}
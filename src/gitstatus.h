@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include "utils.h"
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+enum class GitFileStatus : unsigned char { Clean, Modified, Untracked, Ignored };
+
+struct GitDirStatus {
+  std::string dirPath;
+  bool inRepo = false;
+  std::unordered_map<std::string, GitFileStatus> statuses; // Non-clean only
+};
+
+// One entry of .git/index, with the stat fields used to spot modifications.
+struct GitIndexEntry {
+  std::string path; // Relative to the work tree root
+  uint32_t mtimeSec;
+  uint32_t mtimeNsec;
+  uint32_t ino;
+  uint32_t mode;
+  uint32_t size;
+  bool conflicted; // Has a non-zero merge stage
+};
+
+// Parses the entries of an index file (versions 2-4, see
+// Documentation/gitformat-index.txt). Returns false if it is malformed or
+// cut short.
+bool parseGitIndex(const unsigned char *data, size_t size,
+                   std::vector<GitIndexEntry> &entries);
+
+// Computes git status marks for the entries of dirPath on a background
+// thread, by reading .git/index directly instead of running `git status`,
+// and hands the result to done on that thread. Parsed indexes are cached per
+// repository and reused while the index file's mtime and size are unchanged.
+//
+// owner identifies the requester (a pane): its newer request replaces the
+// one still waiting and abandons the one being computed, whose done is then
+// never called.
+void requestGitStatus(const void *owner, const std::string &dirPath,
+                      const std::vector<FileEntry> &entries,
+                      std::function<void(GitDirStatus)> done);
+
+// Forgets the clean verdicts that a change in dirPath may have made wrong:
+// its own and those of the directories above it. Called when the watch on
+// dirPath reports a change.
+void invalidateGitStatus(const std::string &dirPath);
@@ -0,0 +1,294 @@
+#include "grep.h"
+#include "walk.h"
+#include <algorithm>
+#include <cctype>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <regex.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+// Files with a NUL byte in this prefix are treated as binary
+const size_t BINARY_PROBE = 8192;
+// Paths waiting for a searcher; the walk pauses when this many are queued
+const size_t MAX_QUEUED = 4096;
+// Hit lines are cut to this many bytes
+const size_t MAX_LINE_TEXT = 256;
+
+} // namespace
+
+struct ContentSearch::State {
+  GrepOptions options;
+  std::string loweredPattern; // For case-insensitive literals
+  regex_t regex;
+  bool hasRegex = false;
+
+  std::atomic<bool> cancelled{false};
+  std::atomic<size_t> filesSearched{0};
+  std::atomic<bool> hitLimit{false};
+
+  std::mutex mutex;
+  std::condition_variable queued;  // A path was queued or the walk ended
+  std::condition_variable drained; // A searcher took a path
+  std::deque<std::string> paths;
+  bool walkDone = false;
+  int searchersRunning = 0;
+  size_t hitCount = 0;
+  std::vector<GrepHit> hits; // Not yet taken
+  std::function<void()> ready;
+
+  ~State() {
+    if (hasRegex)
+      regfree(&regex);
+  }
+
+  void searchFile(const std::string &path);
+  void addHits(std::vector<GrepHit> &found);
+};
+
+void ContentSearch::State::addHits(std::vector<GrepHit> &found) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto &hit : found) {
+      if (hitCount >= options.maxHits) {
+        hitLimit = true;
+        cancelled = true;
+        queued.notify_all();
+        drained.notify_all();
+        break;
+      }
+      hits.push_back(std::move(hit));
+      hitCount++;
+    }
+  }
+  if (ready)
+    ready();
+}
+
+void ContentSearch::State::searchFile(const std::string &path) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0 ||
+      (uint64_t)st.st_size > options.maxFileSize) {
+    close(fd);
+    return;
+  }
+  // Read rather than mapped: a file truncated while it is searched would
+  // fault on the pages past its new end. Files are at most maxFileSize.
+  thread_local std::vector<char> buffer;
+  buffer.resize(st.st_size);
+  size_t size = 0;
+  while (size < buffer.size()) {
+    ssize_t n = read(fd, buffer.data() + size, buffer.size() - size);
+    if (n <= 0)
+      break;
+    size += n;
+  }
+  close(fd);
+  const char *data = buffer.data();
+  const char *end = data + size;
+  filesSearched++;
+  if (size == 0 || memchr(data, '\0', std::min(size, BINARY_PROBE)))
+    return;
+
+  std::vector<GrepHit> found;
+  size_t lineNumber = 1;
+  const char *counted = data; // Newlines before this are in lineNumber
+  auto record = [&](const char *lineStart, const char *lineEnd) {
+    lineNumber += std::count(counted, lineStart, '\n');
+    counted = lineStart;
+    found.push_back({path, lineNumber,
+                     std::string(lineStart,
+                                 std::min<size_t>(lineEnd - lineStart,
+                                                  MAX_LINE_TEXT))});
+  };
+  auto lineEndOf = [end](const char *p) {
+    const char *newline =
+        static_cast<const char *>(memchr(p, '\n', end - p));
+    return newline ? newline : end;
+  };
+
+  if (hasRegex) {
+    std::string line;
+    for (const char *p = data; p < end && !cancelled;) {
+      const char *lineEnd = lineEndOf(p);
+      line.assign(p, lineEnd);
+      if (regexec(&regex, line.c_str(), 0, nullptr, 0) == 0)
+        record(p, lineEnd);
+      p = lineEnd + 1;
+    }
+  } else {
+    // memchr for the first byte (both cases if needed) is the prefilter;
+    // only its hits are compared in full
+    const std::string &pattern =
+        options.ignoreCase ? loweredPattern : options.pattern;
+    size_t len = pattern.size();
+    unsigned char first = pattern[0];
+    unsigned char firstUpper = options.ignoreCase ? toupper(first) : first;
+    const char *p = data;
+    // Next occurrence of each at or after p, or null once p passed it
+    const char *nextLower = nullptr;
+    const char *nextUpper = firstUpper == first ? end : nullptr;
+    while (end - p >= (ptrdiff_t)len && !cancelled) {
+      size_t span = end - p - len + 1;
+      if (!nextLower || nextLower < p) {
+        nextLower = static_cast<const char *>(memchr(p, first, span));
+        if (!nextLower)
+          nextLower = end;
+      }
+      if (!nextUpper || nextUpper < p) {
+        nextUpper = static_cast<const char *>(memchr(p, firstUpper, span));
+        if (!nextUpper)
+          nextUpper = end;
+      }
+      const char *candidate = std::min(nextLower, nextUpper);
+      if (end - candidate < (ptrdiff_t)len)
+        break;
+      bool match;
+      if (options.ignoreCase) {
+        match = true;
+        for (size_t i = 1; i < len && match; ++i)
+          match = tolower((unsigned char)candidate[i]) ==
+                  (unsigned char)pattern[i];
+      } else {
+        match = memcmp(candidate + 1, pattern.data() + 1, len - 1) == 0;
+      }
+      if (!match) {
+        p = candidate + 1;
+        continue;
+      }
+      const char *lineStart = candidate;
+      while (lineStart > data && lineStart[-1] != '\n')
+        --lineStart;
+      const char *lineEnd = lineEndOf(candidate);
+      record(lineStart, lineEnd);
+      p = lineEnd + 1; // One hit per line
+    }
+  }
+
+  if (!found.empty())
+    addHits(found);
+}
+
+bool ContentSearch::start(const std::string &root, const EntryMatcher *matcher,
+                          const GrepOptions &options, std::string &error,
+                          std::function<void()> ready) {
+  cancel();
+  auto search = std::make_shared<State>();
+  search->options = options;
+  search->ready = std::move(ready);
+  if (options.pattern.empty()) {
+    error = "Empty pattern";
+    return false;
+  }
+  if (options.regex) {
+    int flags = REG_EXTENDED | REG_NOSUB;
+    if (options.ignoreCase)
+      flags |= REG_ICASE;
+    int result = regcomp(&search->regex, options.pattern.c_str(), flags);
+    if (result != 0) {
+      char message[128];
+      regerror(result, &search->regex, message, sizeof(message));
+      error = message;
+      return false;
+    }
+    search->hasRegex = true;
+  } else if (options.ignoreCase) {
+    search->loweredPattern = options.pattern;
+    for (char &c : search->loweredPattern)
+      c = tolower((unsigned char)c);
+  }
+
+  // Detached like the other background work, so cancelling never waits on
+  // a slow disk; each thread keeps the state alive
+  int searchers = std::max(1u, std::thread::hardware_concurrency());
+  search->searchersRunning = searchers;
+  for (int i = 0; i < searchers; ++i) {
+    std::thread([search]() {
+      std::unique_lock<std::mutex> lock(search->mutex);
+      while (true) {
+        search->queued.wait(lock, [&]() {
+          return !search->paths.empty() || search->walkDone ||
+                 search->cancelled;
+        });
+        if (search->paths.empty() || search->cancelled)
+          break;
+        std::string path = std::move(search->paths.front());
+        search->paths.pop_front();
+        search->drained.notify_one();
+        lock.unlock();
+        search->searchFile(path);
+        lock.lock();
+      }
+      // The last searcher out finishes the search
+      bool finished = --search->searchersRunning == 0;
+      lock.unlock();
+      if (finished && search->ready)
+        search->ready();
+    }).detach();
+  }
+
+  std::shared_ptr<const EntryMatcher> walkMatcher =
+      matcher ? std::make_shared<EntryMatcher>(*matcher) : nullptr;
+  std::thread([search, root, walkMatcher]() {
+    uint64_t maxFileSize = search->options.maxFileSize;
+    walkTree(
+        root, walkMatcher.get(),
+        [&](const std::string &path, const struct stat &st) {
+          if (st.st_size == 0 || (uint64_t)st.st_size > maxFileSize)
+            return;
+          std::unique_lock<std::mutex> lock(search->mutex);
+          search->drained.wait(lock, [&]() {
+            return search->paths.size() < MAX_QUEUED || search->cancelled;
+          });
+          search->paths.push_back(path);
+          search->queued.notify_one();
+        },
+        &search->cancelled);
+    std::lock_guard<std::mutex> lock(search->mutex);
+    search->walkDone = true;
+    search->queued.notify_all();
+  }).detach();
+
+  state = std::move(search);
+  return true;
+}
+
+void ContentSearch::cancel() {
+  if (!state)
+    return;
+  state->cancelled = true;
+  std::lock_guard<std::mutex> lock(state->mutex);
+  state->queued.notify_all();
+  state->drained.notify_all();
+}
+
+bool ContentSearch::take(std::vector<GrepHit> &hits) {
+  if (!state)
+    return false;
+  std::lock_guard<std::mutex> lock(state->mutex);
+  bool finished = (state->walkDone || state->cancelled) &&
+                  state->searchersRunning == 0;
+  if (state->hits.empty())
+    return !finished;
+  for (auto &hit : state->hits)
+    hits.push_back(std::move(hit));
+  state->hits.clear();
+  return true;
+}
+
+size_t ContentSearch::filesSearched() const {
+  return state ? state->filesSearched.load() : 0;
+}
+
+bool ContentSearch::reachedHitLimit() const {
+  return state && state->hitLimit;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "filter.h"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct GrepOptions {
+  std::string pattern;
+  bool regex = false;      // POSIX extended regex instead of a literal
+  bool ignoreCase = false;
+  uint64_t maxFileSize = 16 << 20; // Larger files are skipped
+  size_t maxHits = 10000;          // The search stops after this many
+};
+
+struct GrepHit {
+  std::string path;
+  size_t line; // 1-based
+  std::string text;
+};
+
+// A content search over every file under a root, running in the background.
+// The walk feeds a pool of searcher threads, one per core; each maps a file,
+// skips it if it looks binary (a NUL in the first 8K), and scans it with
+// memchr for the first byte of a literal pattern before comparing the rest.
+// Hits become visible through take() as they are found.
+class ContentSearch {
+public:
+  // Starts searching root. Returns false (with error set) if the regex
+  // doesn't compile. ready is called on a worker thread whenever hits are
+  // added and once the search has finished.
+  bool start(const std::string &root, const EntryMatcher *matcher,
+             const GrepOptions &options, std::string &error,
+             std::function<void()> ready = nullptr);
+  // Stops the walk and the searchers without waiting for them.
+  void cancel();
+  ~ContentSearch() { cancel(); }
+
+  // Appends hits found since the last call. Returns false once the search
+  // has finished and every hit has been taken.
+  bool take(std::vector<GrepHit> &hits);
+  size_t filesSearched() const;
+  bool reachedHitLimit() const;
+
+private:
+  struct State;
+  std::shared_ptr<State> state;
+};
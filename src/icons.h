@@ -1,6 +1,7 @@
 #ifndef PEEK_ICONS_H
 #define PEEK_ICONS_H
 
+#include "sniff.h"
 #include <algorithm>
 #include <locale>
 #include <ncurses.h> // Include ncurses for COLOR_PAIR
@@ -21,6 +22,8 @@
 #define PAIR_CONFIG 9    // Yellow for config/JSON/Make
 #define PAIR_EXECUTABLE 10 // Bright Green/Cyan for executables
 #define PAIR_GIT 11        // Orange/Red for Git
+#define PAIR_GIT_MODIFIED 12  // Yellow status mark for modified entries
+#define PAIR_GIT_UNTRACKED 13 // Green status mark for untracked entries
 
 // --- Struct to hold Icon and Color Pair ---
 struct IconInfo {
@@ -56,17 +59,42 @@ struct IconInfo {
   {"󰆍 ", PAIR_CONFIG} // Object files often build artifacts
 #define ICON_INFO_EXECUTABLE {" ", PAIR_EXECUTABLE}
 
+// --- Short category name for a color pair (used by `peek --list`) ---
+inline const char *iconKindName(int colorPair) {
+  switch (colorPair) {
+  case PAIR_DIRECTORY:
+    return "directory";
+  case PAIR_IMAGE:
+    return "image";
+  case PAIR_VIDEO:
+    return "video";
+  case PAIR_AUDIO:
+    return "audio";
+  case PAIR_ARCHIVE:
+    return "archive";
+  case PAIR_CODE:
+    return "code";
+  case PAIR_TEXT:
+    return "text";
+  case PAIR_CONFIG:
+    return "config";
+  case PAIR_EXECUTABLE:
+    return "executable";
+  case PAIR_GIT:
+    return "git";
+  default:
+    return "file";
+  }
+}
+
 inline std::string toLower(std::string s) {
   std::transform(s.begin(), s.end(), s.begin(),
                  [](unsigned char c) { return std::tolower(c); });
   return s;
 }
 
-// --- Function now returns IconInfo ---
-inline IconInfo getIconForFile(const std::string &filename) {
-  // Default icons
-  static const IconInfo default_file_icon = ICON_INFO_FILE_DEFAULT;
-  static const IconInfo executable_icon = ICON_INFO_EXECUTABLE;
+// --- Icon from the name alone; false if the name says nothing ---
+inline bool getIconForName(const std::string &filename, IconInfo &icon) {
   static const IconInfo directory_icon =
       ICON_INFO_DIRECTORY; // For hidden dir check
   static const IconInfo git_icon = ICON_INFO_GIT;
@@ -126,7 +154,8 @@ inline IconInfo getIconForFile(const std::string &filename) {
   // Check exact filename matches first
   auto exact_it = exact_match_icons.find(lower_filename);
   if (exact_it != exact_match_icons.end()) {
-    return exact_it->second;
+    icon = exact_it->second;
+    return true;
   }
 
   // Handle hidden files like .bashrc
@@ -134,18 +163,21 @@ inline IconInfo getIconForFile(const std::string &filename) {
       filename.find('.', 1) == std::string::npos) {
     auto hidden_it = exact_match_icons.find(lower_filename.substr(1));
     if (hidden_it != exact_match_icons.end()) {
-      return hidden_it->second;
+      icon = hidden_it->second;
+    } else if (lower_filename == ".gitignore" ||
+               lower_filename == ".gitattributes" ||
+               lower_filename == ".gitmodules") {
+      icon = git_icon;
+    } else if (lower_filename == ".bashrc" || lower_filename == ".zshrc" ||
+               lower_filename == ".profile") {
+      icon = shell_icon;
+    } else if (lower_filename == ".config" || lower_filename == ".local" ||
+               lower_filename == ".cache") {
+      icon = directory_icon; // Should be handled by main logic, but as fallback
+    } else {
+      icon = config_icon; // Default hidden file to config icon
     }
-    if (lower_filename == ".gitignore" || lower_filename == ".gitattributes" ||
-        lower_filename == ".gitmodules")
-      return git_icon;
-    if (lower_filename == ".bashrc" || lower_filename == ".zshrc" ||
-        lower_filename == ".profile")
-      return shell_icon;
-    if (lower_filename == ".config" || lower_filename == ".local" ||
-        lower_filename == ".cache")
-      return directory_icon; // Should be handled by main logic, but as fallback
-    return config_icon;      // Default hidden file to config icon
+    return true;
   }
 
   // Find the last dot for extension
@@ -155,33 +187,44 @@ inline IconInfo getIconForFile(const std::string &filename) {
     std::string extension = toLower(filename.substr(dot_pos + 1));
     auto ext_it = extension_icons.find(extension);
     if (ext_it != extension_icons.end()) {
-      return ext_it->second;
+      icon = ext_it->second;
+      return true;
     }
   }
+  return false;
+}
 
-  // Check if executable
-  struct stat st;
-  if (stat(filename.c_str(), &st) == 0) {
-    if (st.st_mode & S_IXUSR || st.st_mode & S_IXGRP || st.st_mode & S_IXOTH) {
-      // Check if it's a known script type first
-      if (dot_pos != std::string::npos && dot_pos != 0 &&
-          dot_pos < filename.length() - 1) {
-        std::string extension = toLower(filename.substr(dot_pos + 1));
-        if (extension == "sh" || extension == "bash" || extension == "zsh" ||
-            extension == "fish" || extension == "py" || extension == "rb" ||
-            extension == "pl") {
-          // Let extension map handle it (or fall through if not mapped)
-        } else {
-          return executable_icon; // Executable but not a mapped script
-        }
-      } else {
-        return executable_icon; // Executable without common script extension
-      }
-    }
+// --- Icon from the name, else the sniffed contents, else the mode ---
+// mode is the entry's cached stat (0 if unknown): the name alone would be
+// stat'd against the working directory, not the one being browsed.
+inline IconInfo getIconForFile(const std::string &filename, mode_t mode = 0,
+                               ContentKind kind = ContentKind::Unknown) {
+  IconInfo icon;
+  if (getIconForName(filename, icon))
+    return icon;
+
+  switch (kind) {
+  case ContentKind::Executable:
+    return ICON_INFO_EXECUTABLE;
+  case ContentKind::Script:
+    return ICON_INFO_SHELL;
+  case ContentKind::Archive:
+    return ICON_INFO_ARCHIVE;
+  case ContentKind::Image:
+    return ICON_INFO_IMAGE;
+  case ContentKind::Text:
+    // An executable text file without #! is still run as a script
+    if (!(mode & (S_IXUSR | S_IXGRP | S_IXOTH)))
+      return ICON_INFO_TEXT;
+    break;
+  case ContentKind::Unknown:
+  case ContentKind::Binary:
+    break;
   }
 
-  // Fallback to default file icon if no other match
-  return default_file_icon;
+  if (mode & (S_IXUSR | S_IXGRP | S_IXOTH))
+    return ICON_INFO_EXECUTABLE;
+  return ICON_INFO_FILE_DEFAULT;
 }
 
 #endif // PEEK_ICONS_H
@@ -0,0 +1,308 @@
+#include "listmode.h"
+#include "icons.h"
+#include "sort.h"
+#include "utils.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <limits.h>
+#include <locale.h>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+enum class ListFormat { Plain, Null, Json };
+enum class ListSort { None, Name, ModTime, Size };
+
+struct ListOptions {
+  ListFormat format = ListFormat::Plain;
+  ListSort sort = ListSort::None;
+  NameSort nameSort = NameSort::Byte;
+  bool reverse = false;
+  FilterSpec filter;
+  std::string match; // Case-insensitive substring, same as `/` search
+  std::string path;
+};
+
+struct ListEntry {
+  std::string name;
+  struct stat st;
+  std::string sortKey;
+};
+
+// Collects output in a large buffer and writes it out in chunks, so streaming
+// a huge directory costs a handful of write(2) calls instead of one per line.
+class OutputBuffer {
+public:
+  OutputBuffer() { buffer.reserve(kFlushThreshold + 4096); }
+  ~OutputBuffer() { flush(); }
+
+  void append(const char *data, size_t len) {
+    buffer.append(data, len);
+    if (buffer.size() >= kFlushThreshold)
+      flush();
+  }
+  void append(const std::string &s) { append(s.data(), s.size()); }
+  void append(char c) { append(&c, 1); }
+
+  void flush() {
+    if (!buffer.empty()) {
+      fwrite(buffer.data(), 1, buffer.size(), stdout);
+      fflush(stdout);
+      buffer.clear();
+    }
+  }
+
+private:
+  static constexpr size_t kFlushThreshold = 64 * 1024;
+  std::string buffer;
+};
+
+static void printListUsage(const char *prog) {
+  fprintf(stderr,
+          "Usage: %s --list [options] [<directory_path>]\n"
+          "  -0, --null          Separate entries with NUL instead of newline\n"
+          "  -j, --json          Print one JSON object per entry\n"
+          "  -s, --sort=KEY      Sort by name, iname, natural, locale, mtime "
+          "or size\n"
+          "                      (default: directory order, streamed)\n"
+          "  -r, --reverse       Reverse the sort order\n"
+          "  -d, --dirs          Only list directories\n"
+          "  -f, --files         Only list files\n"
+          "  -H, --no-hidden     Skip dotfiles\n"
+          "  -I, --include=GLOB  Only list files matching GLOB\n"
+          "  -X, --exclude=GLOB  Skip entries matching GLOB\n"
+          "  -e, --ext=EXT[,EXT] Only list files with these extensions\n"
+          "  -m, --match=TEXT    Only list names containing TEXT "
+          "(case-insensitive)\n",
+          prog);
+}
+
+static bool parseListOptions(int argc, char *argv[], ListOptions &opts) {
+  for (int i = 2; i < argc; ++i) {
+    int filterResult = parseFilterOption(argc, argv, i, opts.filter);
+    if (filterResult < 0)
+      return false;
+    if (filterResult > 0)
+      continue;
+
+    std::string arg = argv[i];
+    std::string value;
+    bool hasValue = false;
+    size_t eq = arg.find('=');
+    if (arg.compare(0, 2, "--") == 0 && eq != std::string::npos) {
+      value = arg.substr(eq + 1);
+      arg = arg.substr(0, eq);
+      hasValue = true;
+    }
+    auto takeValue = [&]() -> bool {
+      if (hasValue)
+        return true;
+      if (i + 1 >= argc)
+        return false;
+      value = argv[++i];
+      return true;
+    };
+
+    if (arg == "-0" || arg == "--null") {
+      opts.format = ListFormat::Null;
+    } else if (arg == "-j" || arg == "--json") {
+      opts.format = ListFormat::Json;
+    } else if (arg == "-r" || arg == "--reverse") {
+      opts.reverse = true;
+    } else if (arg == "-s" || arg == "--sort") {
+      if (!takeValue())
+        return false;
+      if (value == "name") {
+        opts.sort = ListSort::Name;
+        opts.nameSort = NameSort::Byte;
+      } else if (value == "iname") {
+        opts.sort = ListSort::Name;
+        opts.nameSort = NameSort::CaseInsensitive;
+      } else if (value == "natural") {
+        opts.sort = ListSort::Name;
+        opts.nameSort = NameSort::Natural;
+      } else if (value == "locale") {
+        opts.sort = ListSort::Name;
+        opts.nameSort = NameSort::Locale;
+      } else if (value == "mtime") {
+        opts.sort = ListSort::ModTime;
+      } else if (value == "size") {
+        opts.sort = ListSort::Size;
+      } else if (value == "none") {
+        opts.sort = ListSort::None;
+      } else {
+        fprintf(stderr, "peek: Unknown sort key: %s\n", value.c_str());
+        return false;
+      }
+    } else if (arg == "-m" || arg == "--match") {
+      if (!takeValue())
+        return false;
+      opts.match = toLower(value);
+    } else if (!arg.empty() && arg[0] == '-') {
+      fprintf(stderr, "peek: Unknown option: %s\n", arg.c_str());
+      return false;
+    } else if (opts.path.empty()) {
+      opts.path = arg;
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Filters are applied by scanDirectory itself; only --match is left here
+static bool acceptEntry(const ListOptions &opts, const char *name) {
+  if (!opts.match.empty() &&
+      toLower(name).find(opts.match) == std::string::npos)
+    return false;
+  return true;
+}
+
+static void appendJsonString(OutputBuffer &out, const char *s) {
+  out.append('"');
+  for (const unsigned char *p = (const unsigned char *)s; *p; ++p) {
+    switch (*p) {
+    case '"':
+      out.append("\\\"", 2);
+      break;
+    case '\\':
+      out.append("\\\\", 2);
+      break;
+    case '\n':
+      out.append("\\n", 2);
+      break;
+    case '\t':
+      out.append("\\t", 2);
+      break;
+    default:
+      if (*p < 0x20) {
+        char esc[8];
+        snprintf(esc, sizeof(esc), "\\u%04x", *p);
+        out.append(esc, 6);
+      } else {
+        out.append((char)*p);
+      }
+    }
+  }
+  out.append('"');
+}
+
+static void writeEntry(OutputBuffer &out, const ListOptions &opts,
+                       const char *name, const struct stat &st) {
+  if (opts.format == ListFormat::Plain) {
+    out.append(name, strlen(name));
+    out.append('\n');
+    return;
+  }
+  if (opts.format == ListFormat::Null) {
+    out.append(name, strlen(name) + 1); // Include the terminating NUL
+    return;
+  }
+
+  bool isDir = S_ISDIR(st.st_mode);
+  IconInfo iconInfo;
+  if (isDir) {
+    iconInfo = ICON_INFO_DIRECTORY;
+    if (strcmp(name, ".git") == 0) {
+      iconInfo = ICON_INFO_GIT;
+    }
+  } else {
+    iconInfo = getIconForFile(name, st.st_mode);
+  }
+
+  char numbers[96];
+  out.append("{\"name\":", 8);
+  appendJsonString(out, name);
+  out.append(isDir ? ",\"type\":\"dir\",\"kind\":" : ",\"type\":\"file\",\"kind\":");
+  appendJsonString(out, iconKindName(iconInfo.colorPair));
+  out.append(",\"icon\":", 8);
+  appendJsonString(out, iconInfo.icon);
+  int len = snprintf(numbers, sizeof(numbers), ",\"size\":%lld,\"mtime\":%lld",
+                     (long long)st.st_size, (long long)st.st_mtime);
+  out.append(numbers, len);
+  out.append(",\"modified\":", 12);
+  appendJsonString(out, formatModTime(st.st_mtime).c_str());
+  out.append("}\n", 2);
+}
+
+int runListMode(int argc, char *argv[]) {
+  ListOptions opts;
+  if (!parseListOptions(argc, argv, opts)) {
+    printListUsage(argv[0]);
+    return 1;
+  }
+  if (opts.path.empty()) {
+    char cwd_buffer[PATH_MAX];
+    if (getcwd(cwd_buffer, sizeof(cwd_buffer)) == NULL) {
+      perror("peek: Error getting current working directory");
+      return 1;
+    }
+    opts.path = cwd_buffer;
+  }
+
+  OutputBuffer out;
+  EntryMatcher matcher(opts.filter);
+
+  // Without a sort there is nothing to wait for: write each entry as soon as
+  // readdir hands it to us.
+  if (opts.sort == ListSort::None) {
+    bool ok = scanDirectory(
+        opts.path, [&](const char *name, const struct stat &st, bool) {
+          if (acceptEntry(opts, name))
+            writeEntry(out, opts, name, st);
+        },
+        &matcher);
+    return ok ? 0 : 1;
+  }
+
+  std::vector<ListEntry> entries;
+  bool ok = scanDirectory(opts.path,
+                          [&](const char *name, const struct stat &st, bool) {
+                            if (acceptEntry(opts, name))
+                              entries.push_back({name, st, std::string()});
+                          },
+                          &matcher);
+  if (!ok)
+    return 1;
+
+  switch (opts.sort) {
+  case ListSort::Name:
+    if (opts.nameSort == NameSort::Locale)
+      setlocale(LC_COLLATE, "");
+    for (auto &entry : entries)
+      entry.sortKey = makeCollationKey(entry.name, opts.nameSort);
+    std::sort(entries.begin(), entries.end(),
+              [](const ListEntry &a, const ListEntry &b) {
+                return a.sortKey < b.sortKey;
+              });
+    break;
+  case ListSort::ModTime:
+    // Same order as the `m` toggle in the UI: newest files first,
+    // directories last
+    std::stable_sort(entries.begin(), entries.end(),
+                     [](const ListEntry &a, const ListEntry &b) {
+                       bool aDir = S_ISDIR(a.st.st_mode);
+                       bool bDir = S_ISDIR(b.st.st_mode);
+                       if (aDir != bDir)
+                         return !aDir;
+                       return a.st.st_mtime > b.st.st_mtime;
+                     });
+    break;
+  case ListSort::Size:
+    std::stable_sort(entries.begin(), entries.end(),
+                     [](const ListEntry &a, const ListEntry &b) {
+                       return a.st.st_size > b.st.st_size;
+                     });
+    break;
+  case ListSort::None:
+    break;
+  }
+  if (opts.reverse)
+    std::reverse(entries.begin(), entries.end());
+
+  for (const auto &entry : entries)
+    writeEntry(out, opts, entry.name.c_str(), entry.st);
+  return 0;
+}
@@ -0,0 +1,5 @@
+#pragma once
+
+// Entry point for `peek --list`: prints the listing of a directory to stdout
+// without starting the ncurses UI. Returns the process exit code.
+int runListMode(int argc, char *argv[]);
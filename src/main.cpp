@@ -1,14 +1,29 @@
 #include "actions.h"
+#include "archive.h"
+#include "dircache.h"
+#include "eventloop.h"
+#include "gitstatus.h"
 #include "icons.h"
+#include "listmode.h"
+#include "pane.h"
+#include "prefetch.h"
+#include "safeio.h"
+#include "sniff.h"
+#include "sort.h"
+#include "window.h"
 #include "utils.h"
 #include <algorithm>
+#include <chrono>
 #include <cstdio>
 #include <filesystem>
+#include <functional>
 #include <limits.h>
 #include <locale.h>
 #include <ncurses.h>
 #include <string>
+#include <optional>
 #include <sys/stat.h>
+#include <thread>
 #include <unistd.h>
 #include <utility>
 #include <vector>
@@ -17,14 +32,149 @@ namespace fs = std::filesystem;
 
 #define SUBSTR_LEN COLS / 2
 
+// How long the cursor has to rest on a directory before it is prefetched
+const int PREFETCH_DELAY_MS = 120;
+// How long the last key pressed stays in the corner of the status line
+const int KEY_DISPLAY_MS = 1500;
+// Shortest time between rereads of a directory that keeps changing
+const int DIR_REREAD_MS = 250;
+// How much of an archive member the preview pane reads
+const size_t ARCHIVE_PREVIEW_BYTES = 16384;
+
+// Optional metadata columns, chosen with --columns and toggled with i
+enum DetailColumn {
+  COLUMN_PERMS = 1 << 0,
+  COLUMN_OWNER = 1 << 1,
+  COLUMN_LINKS = 1 << 2,
+  COLUMN_SIZE = 1 << 3,
+  COLUMN_TARGET = 1 << 4, // Shown after the name rather than on the right
+};
+const int DEFAULT_COLUMNS = COLUMN_PERMS | COLUMN_OWNER | COLUMN_SIZE;
+
+// Parses "size,perms,owner,links,target"; returns -1 on an unknown name.
+int parseColumns(const std::string &list) {
+  int columns = 0;
+  size_t start = 0;
+  while (start <= list.size()) {
+    size_t end = list.find(',', start);
+    if (end == std::string::npos)
+      end = list.size();
+    std::string name = list.substr(start, end - start);
+    if (name == "perms")
+      columns |= COLUMN_PERMS;
+    else if (name == "owner")
+      columns |= COLUMN_OWNER;
+    else if (name == "links")
+      columns |= COLUMN_LINKS;
+    else if (name == "size")
+      columns |= COLUMN_SIZE;
+    else if (name == "target")
+      columns |= COLUMN_TARGET;
+    else if (!name.empty())
+      return -1;
+    start = end + 1;
+  }
+  return columns;
+}
+
+// Width of formatDetails' output for a file
+int detailsWidth(int columns) {
+  int width = 12; // The modification time
+  if (columns & COLUMN_PERMS)
+    width += 12;
+  if (columns & COLUMN_OWNER)
+    width += 19;
+  if (columns & COLUMN_LINKS)
+    width += 7;
+  if (columns & COLUMN_SIZE)
+    width += 8;
+  return width;
+}
+
+// The right-hand columns of a row, from the entry's cached stat; a symlink
+// whose own stat is loaded shows that, as ls -l does. The modification time
+// always comes last and is left blank for directories unless other columns
+// are shown.
+std::string formatDetails(const FileEntry &entry, int columns) {
+  bool ownStat = entry.meta.isLink && entry.linkMeta.valid;
+  const EntryStat &meta = ownStat ? entry.linkMeta : entry.meta;
+  if (!meta.valid)
+    return "";
+  std::string details;
+  char field[64];
+  if (columns & COLUMN_PERMS) {
+    details += formatPermissions(meta);
+    details += "  ";
+  }
+  if (columns & COLUMN_OWNER) {
+    snprintf(field, sizeof(field), "%-8.8s %-8.8s  ",
+             userName(meta.uid).c_str(), groupName(meta.gid).c_str());
+    details += field;
+  }
+  if (columns & COLUMN_LINKS) {
+    snprintf(field, sizeof(field), "%5lu  ", (unsigned long)meta.links);
+    details += field;
+  }
+  if (columns & COLUMN_SIZE) {
+    snprintf(field, sizeof(field), "%6s  ",
+             entry.isDir && !ownStat ? "-" : formatSize(meta.size).c_str());
+    details += field;
+  }
+  if (!entry.isDir || !details.empty())
+    details += formatModTime(meta.mtime);
+  return details;
+}
+
 bool isValidPath(const std::string &path) {
   struct stat buffer;
-  return (stat(path.c_str(), &buffer) == 0);
+  return statWithDeadline(path, buffer) == IoStatus::Ok;
 }
 
 int main(int argc, char *argv[]) {
+  if (argc >= 2 && std::string(argv[1]) == "--list") {
+    return runListMode(argc, argv);
+  }
+
   std::string initialPath;
-  if (argc == 1) {
+  bool useIndex = false;
+  size_t windowLimit = 0;
+  bool showDetails = false;
+  int detailColumns = DEFAULT_COLUMNS;
+  FilterSpec scanFilter;
+  for (int i = 1; i < argc; ++i) {
+    int filterResult = parseFilterOption(argc, argv, i, scanFilter);
+    if (filterResult > 0)
+      continue;
+    std::string arg = argv[i];
+    if (filterResult < 0) {
+      fprintf(stderr, "peek: Missing value for %s\n", arg.c_str());
+      return 1;
+    } else if (arg == "--index") {
+      useIndex = true;
+    } else if (arg.compare(0, 9, "--window=") == 0) {
+      windowLimit = strtoul(arg.c_str() + 9, nullptr, 10);
+    } else if (arg.compare(0, 10, "--columns=") == 0) {
+      detailColumns = parseColumns(arg.substr(10));
+      if (detailColumns < 0) {
+        fprintf(stderr, "peek: Unknown column in %s\n", arg.c_str());
+        return 1;
+      }
+      showDetails = true;
+    } else if (initialPath.empty() && arg[0] != '-') {
+      initialPath = arg;
+    } else {
+      fprintf(stderr,
+              "Usage: %s [--index] [--window=N] [--columns=LIST] "
+              "[filter options] "
+              "[<directory_path>]\n",
+              argv[0]);
+      fprintf(stderr, "       %s --list [options] [<directory_path>]\n",
+              argv[0]);
+      return 1;
+    }
+  }
+
+  if (initialPath.empty()) {
     char cwd_buffer[PATH_MAX];
     if (getcwd(cwd_buffer, sizeof(cwd_buffer)) != NULL) {
       initialPath = cwd_buffer;
@@ -32,17 +182,14 @@ int main(int argc, char *argv[]) {
       perror("peek: Error getting current working directory");
       return 1;
     }
-  } else if (argc == 2) {
-    initialPath = argv[1];
-    if (!isValidPath(initialPath)) {
-      fprintf(stderr, "peek: Invalid path: %s\n", initialPath.c_str());
-      return 1;
-    }
-  } else {
-    fprintf(stderr, "Usage: %s [<directory_path>]\n", argv[0]);
+  } else if (!isValidPath(initialPath)) {
+    fprintf(stderr, "peek: Invalid path: %s\n", initialPath.c_str());
     return 1;
   }
 
+  setScanFilter(scanFilter);
+  setListingLimit(windowLimit);
+
   setlocale(LC_ALL, "");
   initscr();
   noecho();
@@ -62,137 +209,657 @@ int main(int argc, char *argv[]) {
     init_pair(PAIR_CONFIG, COLOR_YELLOW, -1);
     init_pair(PAIR_EXECUTABLE, COLOR_GREEN, -1);
     init_pair(PAIR_GIT, COLOR_RED, -1);
+    init_pair(PAIR_GIT_MODIFIED, COLOR_YELLOW, -1);
+    init_pair(PAIR_GIT_UNTRACKED, COLOR_GREEN, -1);
     // Add more init_pair calls if more PAIR_XXX constants exist
   }
   keypad(stdscr, TRUE);
   curs_set(0);
 
-  int selectedIndex = 0;
-  int topIndex = 0;
   bool inDeleteMode = false;
-  std::vector<std::pair<std::string, bool>> currentFiles;
-  std::string currentPath = initialPath;
-  currentFiles = getDirectoryContents(currentPath);
 
-  // Search-related variables
-  std::string searchTerm;
-  std::vector<int> matchIndices;
-  int currentMatchIndex = -1;
-  bool sortByModifiedTime = false; // Flag to track sort state
+  // Tabs, each with its own cursor, sort and filter. With split on, the
+  // active one is shown side by side with the pane at otherIndex.
+  std::vector<std::shared_ptr<Pane>> panes{std::make_shared<Pane>()};
+  size_t activeIndex = 0;
+  size_t otherIndex = 0;
+  bool split = false;
+  // The panes drawn last frame; a tab coming back into view was unwatched
+  std::vector<std::weak_ptr<Pane>> shownLastFrame = {panes[0]};
+  Pane &firstPane = *panes[0];
+  firstPane.currentPath = initialPath;
+  activatePane(panes[0]);
+
+  // Everything outside input (worker completions, timers, directory
+  // changes) reaches the main loop through this
+  EventLoop loop;
+  EventLoop::Poster poster = loop.poster();
+
+  // With --index, render the cached listing right away and revalidate it
+  // against the directory's mtime on a background thread.
+  std::function<void(std::optional<DirectoryIndex> &)> applyIndexRefresh;
+  DirectoryIndex startupIndex;
+  if (useIndex && loadDirectoryIndex(initialPath, startupIndex)) {
+    firstPane.currentFiles =
+        filterDirectoryContents(initialPath, startupIndex.entries);
+    // Detached so quitting never waits on a slow filesystem
+    std::thread([path = initialPath, cached = std::move(startupIndex),
+                 poster, &applyIndexRefresh]() mutable {
+      std::optional<DirectoryIndex> fresh;
+      if (isDirectoryIndexStale(path, cached)) {
+        DirectoryIndex rebuilt;
+        if (rebuildDirectoryIndex(path, rebuilt))
+          fresh = std::move(rebuilt);
+      }
+      // Only touched on the main thread, when the post is drained
+      poster.post([&applyIndexRefresh, fresh = std::move(fresh)]() mutable {
+        applyIndexRefresh(fresh);
+      });
+    }).detach();
+  } else if (useIndex) {
+    auto index = std::make_shared<DirectoryIndex>();
+    if (runWithDeadline(initialPath, [path = initialPath, index]() {
+          rebuildDirectoryIndex(path, *index);
+        }))
+      firstPane.currentFiles =
+          filterDirectoryContents(initialPath, index->entries);
+  } else {
+    firstPane.currentFiles = getDirectoryContents(initialPath);
+  }
+  firstPane.listing = currentDirectoryListing(initialPath);
+  listingReplaced(firstPane);
+
+  applyIndexRefresh = [&initialPath, indexPane = std::weak_ptr<Pane>(
+                                         panes[0])](
+                          std::optional<DirectoryIndex> &fresh) {
+    std::shared_ptr<Pane> pane = indexPane.lock();
+    if (!fresh || !pane || pane->currentPath != initialPath)
+      return;
+    std::vector<FileEntry> &currentFiles = pane->currentFiles;
+    std::string selectedName;
+    if (pane->selectedIndex >= 0 &&
+        pane->selectedIndex < (int)currentFiles.size())
+      selectedName = currentFiles[pane->selectedIndex].name;
+    withPaneView(*pane, [&]() {
+      patchDirectoryListing(
+          currentFiles, filterDirectoryContents(initialPath, fresh->entries));
+      if (pane->sortByModifiedTime)
+        sortByModTime(initialPath, currentFiles);
+      else
+        sortByName(currentFiles, getNameSort());
+    });
+    pane->listing = currentDirectoryListing(initialPath);
+    listingReplaced(*pane);
+    int row = rowOf(*pane, selectedName);
+    if (row >= 0)
+      pane->selectedIndex = row;
+    if (pane->selectedIndex < pane->topIndex ||
+        pane->selectedIndex >= pane->topIndex + LINES - 2)
+      pane->topIndex = std::max(0, pane->selectedIndex - (LINES - 3) / 2);
+  };
+
+  // Speculative loading of the directory under the cursor, and the
+  // Miller-column preview pane that shows it
+  DirectoryPrefetcher prefetcher(
+      16, windowLimit > 0 ? std::min<size_t>(windowLimit, 200000) : 200000);
+  bool showPreview = false;
+  std::string prefetchCandidate;
+  bool prefetchRequested = false;
+  auto prefetchCandidateSince = std::chrono::steady_clock::now();
+  std::string previewPath;
+  std::vector<FileEntry> previewFiles;
+  bool previewLoaded = false;
+  prefetcher.setReadyCallback([poster, &previewLoaded, &previewPath](
+                                  const std::string &path) {
+    poster.post([&previewLoaded, &previewPath, path]() {
+      if (path == previewPath)
+        previewLoaded = false; // Pick it up on this frame
+    });
+  });
+
+  std::string previewText; // Head of the selected archive member
+
+  // Icons for files the name says nothing about come from their first bytes,
+  // read in the background for the rows on screen
+  ContentSniffer sniffer;
+  sniffer.setReadyCallback([poster]() {
+    poster.post([]() {}); // Redraw with the new icons
+  });
+
+  // A mount that stopped responding shows up empty; reread once it is back
+  bool mountRecovered = false;
+  setIoRecoveredCallback([poster, &mountRecovered](const std::string &) {
+    poster.post([&mountRecovered]() { mountRecovered = true; });
+  });
 
   int ch;
+  // ncurses may already hold more input than poll() will report (a paste,
+  // or keys read ahead with an escape sequence), so after each key the loop
+  // comes back for the next one without blocking until getch() runs dry
+  bool keyPending = false;
   std::string lastKeyPressed;
-  int keyDisplayTimeout = 0;
+  auto keyDisplayUntil = std::chrono::steady_clock::now();
+  // Watched directories that changed since they were last reread
+  std::vector<std::string> changedDirectories;
+  auto lastDirReread = std::chrono::steady_clock::time_point();
   while (true) {
+    auto now = std::chrono::steady_clock::now();
+    loop.drain();
+
+    // The active pane's state, under the names the actions take; held so
+    // closing the tab can't free it mid-frame
+    std::shared_ptr<Pane> activePane = panes[activeIndex];
+    activatePane(activePane);
+    Pane &pane = *activePane;
+    std::string &currentPath = pane.currentPath;
+    std::vector<FileEntry> &currentFiles = pane.currentFiles;
+    int &selectedIndex = pane.selectedIndex;
+    int &topIndex = pane.topIndex;
+    std::string &searchTerm = pane.searchTerm;
+    std::vector<int> &matchIndices = pane.matchIndices;
+    int &currentMatchIndex = pane.currentMatchIndex;
+    bool &sortByModifiedTime = pane.sortByModifiedTime;
+    WindowedListing &window = pane.window;
+    ArchiveBrowser &archive = pane.archive;
+    std::vector<Pane *> visiblePanes = {&pane};
+    if (split)
+      visiblePanes.push_back(panes[otherIndex].get());
+
+    // A tab that was hidden wasn't watched, so its listing may be stale
+    std::vector<std::weak_ptr<Pane>> shownNow = {panes[activeIndex]};
+    if (split)
+      shownNow.push_back(panes[otherIndex]);
+    for (auto &now : shownNow) {
+      auto shown = now.lock();
+      bool wasShown = std::any_of(
+          shownLastFrame.begin(), shownLastFrame.end(),
+          [&shown](const std::weak_ptr<Pane> &last) {
+            return last.lock() == shown;
+          });
+      if (!wasShown && !shown->archive.isOpen() && !shown->window.isOpen())
+        withPaneView(*shown, [&shown]() { reapplyView(*shown, true); });
+    }
+    shownLastFrame = std::move(shownNow);
+
+    // A listing another pane reread (or adopted) replaces this one's view
+    for (auto &other : panes) {
+      if (other == activePane || other->window.isOpen())
+        continue;
+      auto latest = currentDirectoryListing(other->currentPath);
+      if (latest && latest != other->listing)
+        withPaneView(*other, [&other]() { reapplyView(*other); });
+    }
+
+    // Time until the next timer (prefetch rest delay, directory
+    // reread, key display expiry)
+    int waitMs = -1;
+    auto untilDeadline = [&](std::chrono::steady_clock::time_point deadline) {
+      int ms = (int)std::chrono::duration_cast<std::chrono::milliseconds>(
+                   deadline - now)
+                   .count() +
+               1;
+      waitMs = waitMs < 0 ? std::max(ms, 0) : std::min(waitMs, std::max(ms, 0));
+    };
+
+    // Reread changed directories, at most every DIR_REREAD_MS so a build
+    // writing into one doesn't turn every event into a rescan
+    if (!changedDirectories.empty()) {
+      auto due = lastDirReread + std::chrono::milliseconds(DIR_REREAD_MS);
+      if (now >= due) {
+        // The first pane on a changed directory rereads it; the others
+        // reuse that listing
+        for (const std::string &changed : changedDirectories) {
+          invalidateDirectoryListing(changed);
+          for (Pane *shown : visiblePanes) {
+            if (shown->currentPath != changed || shown->window.isOpen())
+              continue;
+            withPaneView(*shown, [shown]() { reapplyView(*shown, true); });
+            shown->gitStatusPath.clear(); // Marks may have changed too
+          }
+          if (changed == prefetchCandidate)
+            prefetchRequested = false; // Read it again for the preview
+        }
+        changedDirectories.clear();
+        lastDirReread = now;
+      } else {
+        untilDeadline(due);
+      }
+    }
+
+    std::string stuckMount = unresponsiveMount(currentPath);
+    if (mountRecovered) {
+      mountRecovered = false;
+      for (Pane *shown : visiblePanes) {
+        if (unresponsiveMount(shown->currentPath).empty() &&
+            !shown->archive.isOpen() && !shown->window.isOpen()) {
+          withPaneView(*shown, [shown]() { reapplyView(*shown, true); });
+          shown->gitStatusPath.clear();
+        }
+      }
+      prefetchRequested = false;
+    }
+    // Adding a watch resolves the path, which would hang on a stuck mount
+    std::vector<std::string> watchPaths;
+    for (Pane *shown : visiblePanes) {
+      if (!shown->window.isOpen() && !shown->archive.isOpen() &&
+          unresponsiveMount(shown->currentPath).empty())
+        watchPaths.push_back(shown->currentPath);
+    }
+    // The prefetched listing of the directory under the cursor is trusted
+    // only while its watch is in place
+    if (!prefetchCandidate.empty() &&
+        unresponsiveMount(prefetchCandidate).empty() &&
+        std::find(watchPaths.begin(), watchPaths.end(), prefetchCandidate) ==
+            watchPaths.end())
+      watchPaths.push_back(prefetchCandidate);
+    loop.watchDirectories(watchPaths);
+    setWatchedDirectories(watchPaths);
+
+    for (Pane *shown : visiblePanes) {
+      if (shown->archive.isOpen() &&
+          shown->gitStatusPath != shown->currentPath) {
+        shown->gitStatusPath = shown->currentPath;
+        shown->gitStatus = GitDirStatus();
+      } else if (shown->gitStatusPath != shown->currentPath) {
+        // Replaces this pane's request for the directory it just left
+        shown->gitStatusPath = shown->currentPath;
+        shown->gitStatus = GitDirStatus();
+        // The tab may be closed by the time the result lands
+        std::weak_ptr<Pane> target;
+        for (auto &candidate : panes) {
+          if (candidate.get() == shown)
+            target = candidate;
+        }
+        requestGitStatus(shown, shown->currentPath, shown->currentFiles,
+                         [poster, target](GitDirStatus result) {
+                           poster.post([target, result = std::move(
+                                                    result)]() mutable {
+                             auto owner = target.lock();
+                             if (owner &&
+                                 owner->gitStatusPath == result.dirPath)
+                               owner->gitStatus = std::move(result);
+                           });
+                         });
+      }
+    }
+
+    if (windowLimit > 0 && currentPath != window.getPath()) {
+      if (isListingTruncated(currentPath)) {
+        window.open(currentPath, windowLimit, currentFiles);
+        selectedIndex = 0;
+        topIndex = 0;
+        listingReplaced(pane);
+      } else if (window.isOpen()) {
+        window.close();
+      }
+    }
+    if (window.isOpen() && window.follow(currentFiles, selectedIndex, topIndex))
+      listingReplaced(pane);
 
     if (selectedIndex < 0)
       selectedIndex = 0;
-    if (!currentFiles.empty() && selectedIndex >= currentFiles.size())
+    if (!currentFiles.empty() && selectedIndex >= (int)currentFiles.size())
       selectedIndex = currentFiles.size() - 1;
     if (currentFiles.empty())
       selectedIndex = 0;
-    clear();
 
-    int row = 1;
-    for (size_t i = topIndex; i < currentFiles.size() && row < LINES - 1;
-         ++i, ++row) {
-
-      std::string displayName = currentFiles[i].first;
-      IconInfo iconInfo;
-      bool isSelected = ((int)i == selectedIndex);
-      int selectionAttrs = 0;
+    // Prefetch the selected directory once the cursor rests on it
+    std::string selectedDir;
+    if (!archive.isOpen() && !currentFiles.empty() &&
+        currentFiles[selectedIndex].isDir)
+      selectedDir = BUILD_FULL_PATH;
+    if (selectedDir != prefetchCandidate) {
+      // The old candidate loses its watch, and a scan of it still running
+      // is no longer wanted
+      if (!prefetchCandidate.empty())
+        prefetcher.invalidate(prefetchCandidate);
+      prefetcher.cancel();
+      prefetchCandidate = selectedDir;
+      prefetchRequested = false;
+      prefetchCandidateSince = now;
+    }
+    if (!prefetchCandidate.empty() && !prefetchRequested) {
+      auto due = prefetchCandidateSince +
+                 std::chrono::milliseconds(PREFETCH_DELAY_MS);
+      if (now >= due) {
+        prefetcher.request(prefetchCandidate);
+        prefetchRequested = true;
+      } else {
+        untilDeadline(due);
+      }
+    }
 
-      bool isSearchMatch = false;
-      // Check if this item is a search match
-      if (!searchTerm.empty()) {
-        std::string lowerFilename = toLower(displayName);
-        std::string lowerSearchTerm = toLower(searchTerm);
-        isSearchMatch =
-            (lowerFilename.find(lowerSearchTerm) != std::string::npos);
+    // The split view takes the preview pane's half of the screen
+    bool previewShown = showPreview && !split;
+    if (previewShown && archive.isOpen()) {
+      // Members are read straight from the archive, no prefetch needed
+      std::string selectedMember =
+          currentFiles.empty() ? "" : BUILD_FULL_PATH;
+      if (previewPath != selectedMember) {
+        previewPath = selectedMember;
+        previewFiles.clear();
+        previewText.clear();
+        previewLoaded = true;
+        const ArchiveMember *member =
+            currentFiles.empty() ? nullptr
+                                 : archive.find(currentFiles[selectedIndex].name);
+        if (member && member->isDir) {
+          std::vector<FileEntry> raw = archive.list(member->path);
+          previewFiles = deriveDirectoryView(raw);
+        } else if (member) {
+          auto text = std::make_shared<std::string>();
+          if (runWithDeadline(archive.getArchivePath(),
+                              [path = archive.getArchivePath(),
+                               member = *member, text]() {
+                                readArchiveMember(path, member, *text,
+                                                  ARCHIVE_PREVIEW_BYTES);
+                              }))
+            previewText = std::move(*text);
+        }
+      }
+    } else if (previewShown && previewPath != prefetchCandidate) {
+      previewPath = prefetchCandidate;
+      previewFiles.clear();
+      previewText.clear();
+      previewLoaded = false;
+    }
+    if (previewShown && !previewLoaded && !previewPath.empty()) {
+      // On a miss the prefetcher's ready callback wakes us up
+      std::vector<FileEntry> raw;
+      if (prefetcher.peek(previewPath, raw)) {
+        previewFiles = deriveDirectoryView(raw);
+        previewLoaded = true;
       }
+    }
 
-      if (!lastKeyPressed.empty()) {
-        move(LINES - 1, COLS - lastKeyPressed.length() - 1);
-        attron(A_DIM);
-        printw("%s", lastKeyPressed.c_str());
-        attroff(A_DIM);
+    if (!lastKeyPressed.empty()) {
+      if (now >= keyDisplayUntil)
+        lastKeyPressed.clear();
+      else
+        untilDeadline(keyDisplayUntil);
+    }
 
-        if (--keyDisplayTimeout <= 0) {
-          lastKeyPressed.clear();
-        }
+    // Sniff the visible files whose names say nothing; their stats are
+    // needed for the rows anyway, so load them together first
+    std::vector<SniffTarget> sniffTargets;
+    for (Pane *shown : visiblePanes) {
+      if (shown->archive.isOpen())
+        continue;
+      std::vector<FileEntry *> unnamed;
+      size_t end = std::min<size_t>(shown->currentFiles.size(),
+                                    shown->topIndex + std::max(LINES - 2, 0));
+      for (size_t i = shown->topIndex; i < end; ++i) {
+        FileEntry &entry = shown->currentFiles[i];
+        IconInfo named;
+        if (!entry.isDir && !getIconForName(entry.name, named))
+          unnamed.push_back(&entry);
       }
+      loadEntryStats(shown->currentPath, unnamed);
+      std::string dirPrefix =
+          shown->currentPath == "/" ? "/" : shown->currentPath + "/";
+      for (FileEntry *entry : unnamed) {
+        ContentKind known;
+        if (entry->meta.valid && S_ISREG(entry->meta.mode) &&
+            entry->meta.size > 0 && !sniffer.lookup(entry->meta, known))
+          sniffTargets.push_back({dirPrefix + entry->name, entry->meta});
+      }
+    }
+    sniffer.request(sniffTargets);
 
-      if (currentFiles[i].second == true) {
-        iconInfo = ICON_INFO_DIRECTORY;
-        if (displayName == ".git") {
-          iconInfo = ICON_INFO_GIT;
-        }
-      } else {
-        iconInfo = getIconForFile(displayName);
+    clear();
+
+    // Draws a pane's rows between columns left and right
+    auto drawPane = [&](Pane &shown, int left, int right, bool isActive) {
+      int width = right - left;
+      int nameLimit = width == COLS ? SUBSTR_LEN : std::max(8, width - 18);
+      int columns = showDetails ? detailColumns : 0;
+      if (columns & ~COLUMN_TARGET) {
+        // Leave room for the details, icon and padding
+        nameLimit = std::max(
+            8, std::min(nameLimit, width - detailsWidth(columns) - 8));
       }
+      const GitDirStatus &marks = shown.gitStatus;
+      bool markable =
+          marks.dirPath == shown.currentPath && !marks.statuses.empty();
 
-      // Determine selection attributes *before* printing anything on the line
-      if (isSelected) {
-        if (inDeleteMode) {
-          selectionAttrs = COLOR_PAIR(1) | A_REVERSE;
+      int row = 1;
+      for (size_t i = shown.topIndex;
+           i < shown.currentFiles.size() && row < LINES - 1; ++i, ++row) {
+
+        FileEntry &fileEntry = shown.currentFiles[i];
+        const std::string &displayName = fileEntry.name;
+        IconInfo iconInfo;
+        bool isSelected = ((int)i == shown.selectedIndex);
+        int selectionAttrs = 0;
+
+        // Check if this item is a search match (matchIndices is ascending)
+        bool isSearchMatch =
+            !shown.searchTerm.empty() &&
+            std::binary_search(shown.matchIndices.begin(),
+                               shown.matchIndices.end(), (int)i);
+
+        if (fileEntry.isDir == true) {
+          iconInfo = ICON_INFO_DIRECTORY;
+          if (displayName == ".git") {
+            iconInfo = ICON_INFO_GIT;
+          }
         } else {
-          selectionAttrs = A_REVERSE | A_DIM;
+          ContentKind kind = ContentKind::Unknown;
+          if (!shown.archive.isOpen())
+            sniffer.lookup(fileEntry.meta, kind);
+          iconInfo = getIconForFile(displayName, fileEntry.meta.mode, kind);
+        }
+
+        // Determine selection attributes *before* printing anything on the
+        // line; the other pane of a split only underlines its cursor
+        if (isSelected) {
+          if (!isActive) {
+            selectionAttrs = A_UNDERLINE;
+          } else if (inDeleteMode) {
+            selectionAttrs = COLOR_PAIR(1) | A_REVERSE;
+          } else {
+            selectionAttrs = A_REVERSE | A_DIM;
+          }
+          attron(selectionAttrs); // Apply selection highlight for the line
+        } else if (isSearchMatch) {
+          // Highlight search matches with bold
+          attron(A_BOLD);
+        }
+
+        // Git status mark in the left margin
+        if (markable) {
+          auto gitIt = marks.statuses.find(displayName);
+          if (gitIt != marks.statuses.end()) {
+            attr_t markAttrs = A_DIM;
+            char mark = '!';
+            if (gitIt->second == GitFileStatus::Modified) {
+              markAttrs = COLOR_PAIR(PAIR_GIT_MODIFIED) | A_BOLD;
+              mark = 'M';
+            } else if (gitIt->second == GitFileStatus::Untracked) {
+              markAttrs = COLOR_PAIR(PAIR_GIT_UNTRACKED);
+              mark = '?';
+            }
+            attron(markAttrs);
+            mvaddch(row, left, mark);
+            attroff(markAttrs);
+            if (isSelected)
+              attron(selectionAttrs);
+          }
+        }
+
+        // Print Icon: Apply specific color only if NOT selected
+        move(row, left + 1); // Position cursor for icon
+        bool iconColorApplied = false;
+        if (!isSelected && iconInfo.colorPair != PAIR_DEFAULT && has_colors()) {
+          attron(COLOR_PAIR(iconInfo.colorPair));
+          iconColorApplied = true;
+        }
+        printw("%s", iconInfo.icon); // Print the icon (inherits
+                                     // selectionAttrs if isSelected)
+        if (iconColorApplied) {
+          attroff(COLOR_PAIR(
+              iconInfo.colorPair)); // Turn off specific icon color immediately
         }
-        attron(selectionAttrs); // Apply selection highlight for the whole line
-      } else if (isSearchMatch) {
-        // Highlight search matches with bold
-        attron(A_BOLD);
-      }
-
-      // Print Icon: Apply specific color only if NOT selected
-      move(row, 1); // Position cursor for icon
-      bool iconColorApplied = false;
-      if (!isSelected && iconInfo.colorPair != PAIR_DEFAULT && has_colors()) {
-        attron(COLOR_PAIR(iconInfo.colorPair));
-        iconColorApplied = true;
-      }
-      printw("%s", iconInfo.icon); // Print the icon (inherits selectionAttrs if
-                                   // isSelected)
-      if (iconColorApplied) {
-        attroff(COLOR_PAIR(
-            iconInfo.colorPair)); // Turn off specific icon color immediately
-      }
-
-      // Print Filename: Inherits selectionAttrs if isSelected, otherwise
-      // default color
-      printw("%s", displayName.substr(0, SUBSTR_LEN).c_str());
-
-      if (!currentFiles[i].second) {
-        std::string fullPath = currentPath == "/"
-                                   ? currentPath + displayName
-                                   : currentPath + "/" + displayName;
-        std::string modTime = getFormattedModTime(fullPath);
-        if (!modTime.empty()) {
-
-          move(row, COLS - modTime.length() - 2); // Right-align with padding
+
+        // Print Filename: Inherits selectionAttrs if isSelected, otherwise
+        // default color
+        layoutEntryName(fileEntry, nameLimit);
+        addnstr(displayName.data(), fileEntry.nameBytes);
+
+        // Everything below comes from the entry's cached stat; entries that
+        // weren't scanned (from the index or the window) are stat'd once here
+        if (!shown.archive.isOpen())
+          loadEntryStat(shown.currentPath, fileEntry);
+        if (fileEntry.meta.isLink && !shown.archive.isOpen())
+          loadLinkTarget(shown.currentPath, fileEntry);
+        if ((columns & COLUMN_TARGET) && fileEntry.meta.isLink) {
+          int room = nameLimit - fileEntry.nameColumns - 4;
+          if (room > 0 && !fileEntry.linkTarget.empty()) {
+            attron(A_DIM);
+            addstr(" -> ");
+            addnstr(fileEntry.linkTarget.data(),
+                    std::min<int>(room, fileEntry.linkTarget.size()));
+            attroff(A_DIM);
+          }
+        }
+        std::string details = formatDetails(fileEntry, columns);
+        if (!details.empty()) {
+          move(row, right - details.length() - 2); // Right-align with padding
           attron(COLOR_PAIR(PAIR_DIRECTORY) | A_DIM);
-          printw("%s", modTime.c_str());
+          printw("%s", details.c_str());
           attroff(COLOR_PAIR(PAIR_DIRECTORY) | A_DIM);
         }
+
+        // Turn off selection attributes
+        if (isSelected) {
+          attroff(selectionAttrs);
+        } else if (isSearchMatch) {
+          attroff(A_BOLD); // Turn off bold for search matches
+        }
+      }
+      attroff(A_REVERSE | A_DIM | A_BOLD | A_UNDERLINE);
+    };
+
+    int listRight = previewShown || split ? COLS / 2 : COLS;
+    if (split) {
+      // The active pane keeps its side; the lower-numbered tab is on the left
+      bool activeLeft = activeIndex < otherIndex;
+      drawPane(pane, activeLeft ? 0 : listRight + 1,
+               activeLeft ? listRight : COLS, true);
+      drawPane(*panes[otherIndex], activeLeft ? listRight + 1 : 0,
+               activeLeft ? COLS : listRight, false);
+      mvvline(1, listRight, ACS_VLINE, LINES - 2);
+    } else {
+      drawPane(pane, 0, listRight, true);
+    }
+
+    // Tab bar, once there is more than one tab
+    if (panes.size() > 1) {
+      move(0, 0);
+      for (size_t t = 0; t < panes.size(); ++t) {
+        const std::string &path = panes[t]->currentPath;
+        std::string name = path == "/" ? path
+                                       : path.substr(path.find_last_of('/') + 1);
+        attr_t tabAttrs = t == activeIndex                ? A_REVERSE
+                          : split && t == otherIndex ? A_BOLD
+                                                         : A_DIM;
+        attron(tabAttrs);
+        printw(" %zu %s ", t + 1, name.c_str());
+        attroff(tabAttrs);
+        addch(' ');
       }
+    }
 
-      // Fill rest of selected line & turn off selection attributes
-      if (isSelected) {
-        int iconVisualWidth = 2;
-        int current_col =
-            1 + iconVisualWidth + displayName.substr(0, SUBSTR_LEN).length();
-        // The selectionAttrs are already on, just fill
-        while (current_col <
-               std::min(static_cast<int>(displayName.length()), SUBSTR_LEN)) {
-          mvaddch(row, current_col++, ' ');
+    // Preview pane: the prefetched listing of the selected directory
+    if (previewShown) {
+      mvvline(1, listRight, ACS_VLINE, LINES - 2);
+      int previewCol = listRight + 2;
+      int previewWidth = COLS - previewCol - 3;
+      int previewRow = 1;
+      if (!previewLoaded && !previewPath.empty()) {
+        attron(A_DIM);
+        mvprintw(previewRow, previewCol, "%s", "...");
+        attroff(A_DIM);
+      }
+      for (size_t i = 0; i < previewFiles.size() && previewRow < LINES - 1;
+           ++i, ++previewRow) {
+        IconInfo previewIcon = ICON_INFO_DIRECTORY;
+        if (!previewFiles[i].isDir) {
+          // Only what was already sniffed; the preview isn't read for icons
+          ContentKind kind = ContentKind::Unknown;
+          sniffer.lookup(previewFiles[i].meta, kind);
+          previewIcon = getIconForFile(previewFiles[i].name,
+                                       previewFiles[i].meta.mode, kind);
+        }
+        move(previewRow, previewCol);
+        if (previewIcon.colorPair != PAIR_DEFAULT && has_colors())
+          attron(COLOR_PAIR(previewIcon.colorPair));
+        printw("%s", previewIcon.icon);
+        if (previewIcon.colorPair != PAIR_DEFAULT && has_colors())
+          attroff(COLOR_PAIR(previewIcon.colorPair));
+        attron(A_DIM);
+        layoutEntryName(previewFiles[i], std::max(0, previewWidth));
+        addnstr(previewFiles[i].name.data(), previewFiles[i].nameBytes);
+        attroff(A_DIM);
+      }
+      if (previewText.find('\0') != std::string::npos) {
+        attron(A_DIM);
+        mvprintw(previewRow, previewCol, "%s", "(binary)");
+        attroff(A_DIM);
+      } else {
+        size_t start = 0;
+        while (start < previewText.size() && previewRow < LINES - 1) {
+          size_t end = previewText.find('\n', start);
+          if (end == std::string::npos)
+            end = previewText.size();
+          std::string line = previewText.substr(start, end - start);
+          for (char &c : line) {
+            if (c == '\t' || c == '\r')
+              c = ' ';
+          }
+          mvaddnstr(previewRow++, previewCol, line.c_str(),
+                    std::max(0, previewWidth));
+          start = end + 1;
         }
-        attroff(selectionAttrs); // Turn off selection highlight after filling
-      } else if (isSearchMatch) {
-        attroff(A_BOLD); // Turn off bold for search matches
       }
     }
 
-    attroff(A_REVERSE | A_DIM | A_BOLD);
+    // Show the active view filter and a non-default sort unless search
+    // status takes the line
+    if (searchTerm.empty() || matchIndices.empty()) {
+      std::string status;
+      if (!getViewFilter().empty())
+        status = "filter: " + getViewFilter().describe();
+      if (window.isOpen()) {
+        char position[96];
+        snprintf(position, sizeof(position), "window: %zu-%zu of %zu%s",
+                 window.windowBase() + 1,
+                 window.windowBase() + currentFiles.size(),
+                 window.totalKnown() ? window.total()
+                                     : window.windowBase() + currentFiles.size(),
+                 window.totalKnown() ? "" : "+");
+        status = position;
+      } else if (sortByModifiedTime || getNameSort() != NameSort::Natural) {
+        if (!status.empty())
+          status += "  ";
+        status += "sort: ";
+        status += sortByModifiedTime ? "modified" : nameSortLabel(getNameSort());
+      }
+      if (!status.empty()) {
+        move(LINES - 1, 0);
+        attron(A_DIM);
+        printw("%s", status.c_str());
+        attroff(A_DIM);
+      }
+    }
+
+    if (!stuckMount.empty()) {
+      move(LINES - 1, 0);
+      clrtoeol();
+      attron(COLOR_PAIR(1));
+      printw("unresponsive: %s", stuckMount.c_str());
+      attroff(COLOR_PAIR(1));
+    }
 
     // Display search status if in search mode
     if (!searchTerm.empty() && !matchIndices.empty()) {
@@ -204,17 +871,56 @@ int main(int argc, char *argv[]) {
       attroff(A_DIM);
     }
 
+    if (!lastKeyPressed.empty()) {
+      move(LINES - 1, COLS - lastKeyPressed.length() - 1);
+      attron(A_DIM);
+      printw("%s", lastKeyPressed.c_str());
+      attroff(A_DIM);
+    }
+
     refresh();
 
+    // Sleep until a key, a posted completion, a change to the directory on
+    // disk or the next timer, whichever comes first
+    loop.wait(keyPending ? 0 : waitMs);
+
+    // Reread on the next frame the timer allows; this includes changes seen
+    // while a modal view was waiting
+    for (const std::string &changed : loop.takeChangedDirectories()) {
+      prefetcher.invalidate(changed);
+      invalidateGitStatus(changed);
+      if (std::find(changedDirectories.begin(), changedDirectories.end(),
+                    changed) == changedDirectories.end())
+        changedDirectories.push_back(changed);
+    }
+
+    // Non-blocking so a wakeup without input (or a signal) never stalls here;
+    // prompts inside actions still block as before
+    nodelay(stdscr, TRUE);
     ch = getch();
+    nodelay(stdscr, FALSE);
+    keyPending = ch != ERR;
 
     if (ch != ERR) {
       lastKeyPressed = keyname(ch);
-      keyDisplayTimeout = 10; // Show for 10 refresh cycles
+      keyDisplayUntil = std::chrono::steady_clock::now() +
+                        std::chrono::milliseconds(KEY_DISPLAY_MS);
     }
 
+    // Whatever the key does, a directory it leaves is remembered as it was
+    if (ch != ERR && ch != KEY_RESIZE)
+      saveViewState(pane);
+
     if (ch == 'q') {
       break;
+    } else if (ch == KEY_RESIZE) {
+      // Name layouts were computed for the old width
+      for (auto &tab : panes) {
+        for (auto &entry : tab->currentFiles)
+          entry.layoutColumns = -1;
+      }
+      for (auto &entry : previewFiles)
+        entry.layoutColumns = -1;
     } else if (ch == KEY_UP || ch == 'k') {
       if (selectedIndex > 0) {
         selectedIndex--;
@@ -233,20 +939,93 @@ int main(int argc, char *argv[]) {
             topIndex = 0;
         }
       }
+    } else if (ch == KEY_NPAGE || ch == KEY_PPAGE) {
+      int page = std::max(1, LINES - 2);
+      selectedIndex += ch == KEY_NPAGE ? page : -page;
+      selectedIndex =
+          std::max(0, std::min(selectedIndex, (int)currentFiles.size() - 1));
+      topIndex = std::max(0, ch == KEY_NPAGE ? selectedIndex - page + 1
+                                              : selectedIndex);
+    } else if (ch == 'g') {
+      if (window.isOpen()) {
+        window.jumpToStart(currentFiles, selectedIndex, topIndex);
+        listingReplaced(pane);
+      } else {
+        selectedIndex = 0;
+        topIndex = 0;
+      }
+    } else if (ch == 'G') {
+      if (window.isOpen()) {
+        window.jumpToEnd(currentFiles, selectedIndex, topIndex, LINES - 2);
+        listingReplaced(pane);
+      } else if (!currentFiles.empty()) {
+        selectedIndex = currentFiles.size() - 1;
+        topIndex = std::max(0, selectedIndex - LINES + 3);
+      }
+    } else if ((ch == 'd' || ch == 'r' || ch == 'm' || ch == 'D' ||
+                ch == 'F' || ch == 'c' || ch == 'o' || ch == '[') &&
+               archive.isOpen()) {
+      // Archives are browsed read-only, and their members have no path on
+      // disk to sort by or bookmark
+    } else if (ch == 'x' && archive.isOpen()) {
+      handleExtractMemberAction(archive, currentFiles, selectedIndex);
     } else if (ch == 'd') {
       inDeleteMode = true;
-      if (handleDeleteAction(currentPath, currentFiles, selectedIndex,
-                             topIndex)) {
+      bool deleted = handleDeleteAction(currentPath, currentFiles,
+                                        selectedIndex, topIndex);
+      if (deleted) {
         inDeleteMode = false;
       }
+      if (deleted && window.isOpen()) {
+        // The listing only holds the first N entries; reread the window
+        window.open(currentPath, windowLimit, currentFiles);
+        selectedIndex = 0;
+        topIndex = 0;
+        listingReplaced(pane);
+      } else if (deleted) {
+        reapplyView(pane, true);
+      }
     } else if (ch == 'r') {
-      handleRenameAction(currentPath, currentFiles, selectedIndex, topIndex);
+      if (handleRenameAction(currentPath, currentFiles, selectedIndex,
+                             topIndex)) {
+        if (window.isOpen()) {
+          window.open(currentPath, windowLimit, currentFiles);
+          selectedIndex = 0;
+          topIndex = 0;
+          listingReplaced(pane);
+        } else {
+          reapplyView(pane, true);
+        }
+      }
     } else if (ch == 'l' || ch == KEY_ENTER || ch == '\n' || ch == '\r' ||
                ch == KEY_RIGHT) {
-      handleEnterDirectoryAction(currentPath, currentFiles, selectedIndex,
-                                 topIndex);
+      if (archive.isOpen()) {
+        if (handleArchiveEnterAction(archive, currentPath, currentFiles,
+                                     selectedIndex, topIndex))
+          listingReplaced(pane);
+      } else if (handleEnterDirectoryAction(currentPath, currentFiles,
+                                            selectedIndex, topIndex,
+                                            &prefetcher)) {
+        restoreViewState(pane);
+      } else if (handleOpenArchiveAction(archive, currentPath, currentFiles,
+                                         selectedIndex, topIndex)) {
+        // Tar and zip files open as a virtual directory, in name order
+        sortByModifiedTime = false;
+        listingReplaced(pane);
+      }
     } else if (ch == 'h' || ch == KEY_LEFT) {
-      handleGoBackAction(currentPath, currentFiles, selectedIndex, topIndex);
+      if (archive.isOpen()) {
+        handleArchiveBackAction(archive, currentPath, currentFiles,
+                                selectedIndex, topIndex);
+        listingReplaced(pane);
+      } else {
+        // Without a remembered cursor, land on the directory we came from
+        std::string from =
+            currentPath.substr(currentPath.find_last_of('/') + 1);
+        if (handleGoBackAction(currentPath, currentFiles, selectedIndex,
+                               topIndex))
+          restoreViewState(pane, from);
+      }
     } else if (ch == '/') {
       // Enter search mode
       handleSearchAction(currentFiles, selectedIndex, topIndex, searchTerm,
@@ -264,34 +1043,63 @@ int main(int argc, char *argv[]) {
       exitSearchMode(searchTerm, matchIndices, currentMatchIndex);
     } else if (ch == 'y') {
       handleCopyPathAction(currentPath, currentFiles, selectedIndex);
+    } else if ((ch == 'm' || ch == 's' || ch == '.' || ch == 't' ||
+                ch == 'f') &&
+               window.isOpen()) {
+      // Sorting and view filters need the whole listing; a windowed
+      // directory is always shown in readdir order
     } else if (ch == 'm') {
-      // Toggle sort mode
+      // Toggle sort mode; the cursor stays on the same entry
       sortByModifiedTime = !sortByModifiedTime;
-
-      // Get fresh directory contents
-      currentFiles = getDirectoryContents(currentPath);
-
-      if (sortByModifiedTime) {
-        // Sort by modified time (directories last)
-        std::sort(currentFiles.begin(), currentFiles.end(),
-                  [&currentPath](const auto &a, const auto &b) {
-                    // Directories go last
-                    if (a.second && !b.second)
-                      return false;
-                    if (!a.second && b.second)
-                      return true;
-
-                    // For files, compare modified times
-                    std::string pathA = currentPath + "/" + a.first;
-                    std::string pathB = currentPath + "/" + b.first;
-                    auto timeA = fs::last_write_time(pathA);
-                    auto timeB = fs::last_write_time(pathB);
-                    return timeA > timeB; // Newest first
-                  });
-      }
-      // Reset selection to top
-      selectedIndex = 0;
-      topIndex = 0;
+      reapplyView(pane);
+    } else if (ch == '.' || ch == 't' || ch == 'f') {
+      FilterSpec spec = getViewFilter();
+      if (ch == '.') {
+        // Toggle dotfiles
+        spec.hideHidden = !spec.hideHidden;
+      } else if (ch == 't') {
+        // Cycle all -> directories only -> files only
+        spec.type = spec.type == TypeFilter::All        ? TypeFilter::DirsOnly
+                    : spec.type == TypeFilter::DirsOnly ? TypeFilter::FilesOnly
+                                                        : TypeFilter::All;
+      } else {
+        // Prompt for a glob; an empty one clears the glob filter
+        move(LINES - 1, 0);
+        clrtoeol();
+        attron(A_DIM);
+        printw("filter glob: ");
+        attroff(A_DIM);
+        echo();
+        curs_set(1);
+        char input[256] = {0};
+        getnstr(input, sizeof(input) - 1);
+        noecho();
+        curs_set(0);
+        spec.includeGlobs.clear();
+        if (input[0] != '\0')
+          spec.includeGlobs.push_back(input);
+      }
+      exitSearchMode(searchTerm, matchIndices, currentMatchIndex);
+      setViewFilter(spec);
+      reapplyView(pane);
+    } else if (ch == 'i') {
+      // Toggle the metadata columns
+      showDetails = !showDetails;
+    } else if (ch == 'p') {
+      // Toggle the preview pane
+      showPreview = !showPreview;
+      previewPath.clear();
+      previewFiles.clear();
+      previewText.clear();
+      previewLoaded = false;
+      prefetchRequested = false; // Request again right away
+      prefetchCandidateSince -= std::chrono::milliseconds(PREFETCH_DELAY_MS);
+    } else if (ch == 's') {
+      // Cycle name order; turns off the modified-time sort
+      setNameSort(nextNameSort(getNameSort()));
+      sortByModifiedTime = false;
+      exitSearchMode(searchTerm, matchIndices, currentMatchIndex);
+      reapplyView(pane);
     } else if (ch == '[') {
       // Add current directory to bookmarks
       addBookmark(currentPath);
@@ -320,11 +1128,35 @@ int main(int argc, char *argv[]) {
       refresh();
     } else if (ch == 'b') {
       // Show bookmarks list
-      handleBookmarkListAction(currentPath, currentFiles, selectedIndex,
-                               topIndex);
+      if (handleBookmarkListAction(currentPath, currentFiles, selectedIndex,
+                                   topIndex)) {
+        archive.close();
+        listingReplaced(pane);
+      }
+    } else if (ch == 'F') {
+      // Search file contents under the current directory
+      if (handleContentSearchAction(currentPath, currentFiles, selectedIndex,
+                                    topIndex, loop)) {
+        exitSearchMode(searchTerm, matchIndices, currentMatchIndex);
+        listingReplaced(pane);
+      }
+    } else if (ch == 'c') {
+      // Compare the current directory with another tree
+      if (handleCompareAction(currentPath, currentFiles, selectedIndex,
+                              topIndex, loop)) {
+        exitSearchMode(searchTerm, matchIndices, currentMatchIndex);
+        listingReplaced(pane);
+      }
+    } else if (ch == 'D') {
+      // Find duplicate files under the current directory
+      if (handleDuplicatesAction(currentPath, currentFiles, selectedIndex,
+                                 topIndex, loop)) {
+        exitSearchMode(searchTerm, matchIndices, currentMatchIndex);
+        listingReplaced(pane);
+      }
     } else if (ch == 'o') {
 
-      if (currentFiles[selectedIndex].second == true || currentFiles.empty() ||
+      if (currentFiles[selectedIndex].isDir == true || currentFiles.empty() ||
           selectedIndex >= (int)currentFiles.size()) {
         refresh();
       } else {
@@ -333,7 +1165,75 @@ int main(int argc, char *argv[]) {
             "open -a \"Brave Browser\" \"" + BUILD_FULL_PATH + "\"";
         int result = system(command.c_str());
       }
+    } else if (ch == 'T' || (ch == '|' && panes.size() == 1)) {
+      // A new tab on the same directory (the archive's, inside one), with
+      // the same sort and filter; its listing comes from the shared cache
+      auto opened = std::make_shared<Pane>();
+      opened->currentPath = currentPath;
+      if (archive.isOpen()) {
+        const std::string &archivePath = archive.getArchivePath();
+        size_t lastSlash = archivePath.find_last_of('/');
+        opened->currentPath =
+            lastSlash == 0 ? "/" : archivePath.substr(0, lastSlash);
+      }
+      opened->viewFilter = getViewFilter();
+      opened->nameSort = getNameSort();
+      opened->sortByModifiedTime = sortByModifiedTime && !archive.isOpen();
+      std::string selectedName =
+          currentFiles.empty() || archive.isOpen()
+              ? ""
+              : currentFiles[selectedIndex].name;
+      opened->currentFiles = getDirectoryContents(opened->currentPath);
+      opened->listing = currentDirectoryListing(opened->currentPath);
+      if (opened->sortByModifiedTime)
+        sortByModTime(opened->currentPath, opened->currentFiles);
+      listingReplaced(*opened);
+      int row = rowOf(*opened, selectedName);
+      if (row >= 0) {
+        opened->selectedIndex = row;
+        opened->topIndex = topIndex;
+      }
+
+      size_t position = activeIndex + 1;
+      panes.insert(panes.begin() + position, opened);
+      if (otherIndex >= position)
+        otherIndex++;
+      if (ch == '|') {
+        split = true;
+        otherIndex = activeIndex;
+      }
+      activeIndex = position;
+    } else if (ch == '|') {
+      // Toggle the dual-pane view
+      split = !split;
+      if (split && otherIndex == activeIndex)
+        otherIndex = (activeIndex + 1) % panes.size();
+    } else if (ch == '\t') {
+      // Other side of the split, or the next tab
+      if (split)
+        std::swap(activeIndex, otherIndex);
+      else
+        activeIndex = (activeIndex + 1) % panes.size();
+    } else if (ch >= '1' && ch <= '9' && (size_t)(ch - '1') < panes.size()) {
+      // Go to tab N; in a split it replaces the active side
+      size_t tab = ch - '1';
+      if (split && tab == otherIndex)
+        otherIndex = activeIndex;
+      activeIndex = tab;
+    } else if (ch == 'W' && panes.size() > 1) {
+      // Close the tab; in a split the other side takes over the screen
+      panes.erase(panes.begin() + activeIndex);
+      if (split) {
+        activeIndex = otherIndex > activeIndex ? otherIndex - 1 : otherIndex;
+        split = false;
+      } else if (activeIndex == panes.size()) {
+        activeIndex--;
+      }
+      otherIndex = std::min(otherIndex, panes.size() - 1);
     }
+
+    // This pane's own reloads are already applied to its view
+    pane.listing = currentDirectoryListing(currentPath);
   }
 
   endwin();
@@ -0,0 +1,151 @@
+#include "pane.h"
+#include "actions.h"
+#include <algorithm>
+#include <ncurses.h>
+
+namespace {
+
+// Directories remembered per tab before the store starts over
+const size_t MAX_VIEW_STATES = 4096;
+
+std::weak_ptr<Pane> activePane;
+
+// Points the search status at the match under the cursor, if it is one
+void updateCurrentMatch(Pane &pane) {
+  auto match = std::lower_bound(pane.matchIndices.begin(),
+                                pane.matchIndices.end(), pane.selectedIndex);
+  pane.currentMatchIndex =
+      match != pane.matchIndices.end() && *match == pane.selectedIndex
+          ? match - pane.matchIndices.begin()
+          : -1;
+}
+
+void indexRows(Pane &pane) {
+  pane.rowByName.clear();
+  pane.rowByName.reserve(pane.currentFiles.size());
+  for (size_t i = 0; i < pane.currentFiles.size(); ++i)
+    pane.rowByName.emplace(pane.currentFiles[i].name, i);
+}
+
+} // namespace
+
+void activatePane(const std::shared_ptr<Pane> &pane) {
+  std::shared_ptr<Pane> previous = activePane.lock();
+  if (previous == pane)
+    return;
+  if (previous) {
+    previous->viewFilter = getViewFilter();
+    previous->nameSort = getNameSort();
+  }
+  activePane = pane;
+  setViewFilter(pane->viewFilter);
+  setNameSort(pane->nameSort);
+}
+
+void withPaneView(Pane &pane, const std::function<void()> &derive) {
+  if (activePane.lock().get() == &pane) {
+    derive();
+    return;
+  }
+  FilterSpec savedFilter = getViewFilter();
+  NameSort savedSort = getNameSort();
+  setViewFilter(pane.viewFilter);
+  setNameSort(pane.nameSort);
+  derive();
+  setViewFilter(savedFilter);
+  setNameSort(savedSort);
+}
+
+void reapplyView(Pane &pane, bool reread) {
+  std::string selectedName;
+  int previousRow = pane.selectedIndex;
+  int offset = pane.selectedIndex - pane.topIndex;
+  if (pane.selectedIndex >= 0 &&
+      pane.selectedIndex < (int)pane.currentFiles.size())
+    selectedName = pane.currentFiles[pane.selectedIndex].name;
+
+  pane.currentFiles = reread ? getDirectoryContents(pane.currentPath)
+                             : refilterDirectoryContents(pane.currentPath);
+  pane.listing = currentDirectoryListing(pane.currentPath);
+  if (pane.sortByModifiedTime)
+    sortByModTime(pane.currentPath, pane.currentFiles);
+  listingReplaced(pane);
+
+  int row = rowOf(pane, selectedName);
+  placeCursor(pane, row >= 0 ? row : previousRow, offset);
+}
+
+void listingReplaced(Pane &pane) {
+  indexRows(pane);
+  if (!pane.searchTerm.empty()) {
+    findSearchMatches(pane.currentFiles, pane.searchTerm, pane.matchIndices);
+    updateCurrentMatch(pane);
+  }
+}
+
+int rowOf(Pane &pane, const std::string &name) {
+  if (name.empty())
+    return -1;
+  // The index is rebuilt wherever currentFiles is replaced; a hit is still
+  // checked, as a rename edits a row in place
+  auto found = pane.rowByName.find(name);
+  if (found == pane.rowByName.end())
+    return -1;
+  if (found->second < (int)pane.currentFiles.size() &&
+      pane.currentFiles[found->second].name == name)
+    return found->second;
+  indexRows(pane);
+  found = pane.rowByName.find(name);
+  return found == pane.rowByName.end() ? -1 : found->second;
+}
+
+void placeCursor(Pane &pane, int row, int offset) {
+  int count = pane.currentFiles.size();
+  pane.selectedIndex = std::max(0, std::min(row, count - 1));
+  int rows = std::max(1, LINES - 2);
+  offset = std::max(0, std::min(offset, rows - 1));
+  pane.topIndex = std::max(0, pane.selectedIndex - offset);
+  updateCurrentMatch(pane);
+}
+
+void saveViewState(Pane &pane) {
+  if (pane.archive.isOpen() || pane.window.isOpen())
+    return;
+  if (pane.viewStates.size() >= MAX_VIEW_STATES &&
+      !pane.viewStates.count(pane.currentPath))
+    pane.viewStates.clear();
+  DirectoryViewState &state = pane.viewStates[pane.currentPath];
+  state.selectedName.clear();
+  if (pane.selectedIndex < (int)pane.currentFiles.size())
+    state.selectedName = pane.currentFiles[pane.selectedIndex].name;
+  state.offset = pane.selectedIndex - pane.topIndex;
+  state.sortByModifiedTime = pane.sortByModifiedTime;
+  state.viewFilter = getViewFilter();
+  state.nameSort = getNameSort();
+}
+
+void restoreViewState(Pane &pane, const std::string &fallbackName) {
+  listingReplaced(pane);
+  auto saved = pane.viewStates.find(pane.currentPath);
+  if (saved == pane.viewStates.end() || pane.archive.isOpen()) {
+    int row = rowOf(pane, fallbackName);
+    placeCursor(pane, std::max(row, 0), (LINES - 3) / 2);
+    return;
+  }
+
+  const DirectoryViewState &state = saved->second;
+  if (state.viewFilter != getViewFilter() || state.nameSort != getNameSort() ||
+      state.sortByModifiedTime != pane.sortByModifiedTime) {
+    setViewFilter(state.viewFilter);
+    setNameSort(state.nameSort);
+    pane.sortByModifiedTime = state.sortByModifiedTime;
+    pane.currentFiles = refilterDirectoryContents(pane.currentPath);
+    if (pane.sortByModifiedTime)
+      sortByModTime(pane.currentPath, pane.currentFiles);
+    listingReplaced(pane);
+  }
+  int row = rowOf(pane, state.selectedName);
+  if (row < 0)
+    row = rowOf(pane, fallbackName);
+  placeCursor(pane, std::max(row, 0), state.offset);
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "archive.h"
+#include "filter.h"
+#include "gitstatus.h"
+#include "sort.h"
+#include "utils.h"
+#include "window.h"
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Where a pane was in a directory it left, restored when it comes back.
+struct DirectoryViewState {
+  std::string selectedName;
+  int offset = 0; // Rows between the top of the screen and the cursor
+  bool sortByModifiedTime = false;
+  FilterSpec viewFilter;
+  NameSort nameSort = NameSort::Natural;
+};
+
+// Everything one tab shows: its directory, cursor, search, sort and filter.
+// The listings themselves live in the shared cache in utils.h, so two panes
+// on the same directory read it once and see each other's rereads.
+struct Pane {
+  std::string currentPath;
+  std::vector<FileEntry> currentFiles;
+  int selectedIndex = 0;
+  int topIndex = 0;
+
+  std::string searchTerm;
+  std::vector<int> matchIndices;
+  int currentMatchIndex = -1;
+
+  bool sortByModifiedTime = false;
+  // Held by the globals in utils.h while the pane is active
+  FilterSpec viewFilter;
+  NameSort nameSort = NameSort::Natural;
+
+  // The shared listing currentFiles was derived from
+  std::shared_ptr<const DirectoryListing> listing;
+
+  // Row of each name in currentFiles, rebuilt by listingReplaced
+  std::unordered_map<std::string, int> rowByName;
+
+  // Per directory visited in this tab
+  std::unordered_map<std::string, DirectoryViewState> viewStates;
+
+  // Git status marks for currentPath, computed in the background
+  GitDirStatus gitStatus;
+  std::string gitStatusPath;
+
+  WindowedListing window;
+  // Set while browsing inside a tar or zip archive; currentPath is then the
+  // virtual path archive/inner/dir and nothing under it exists on disk
+  ArchiveBrowser archive;
+};
+
+// Makes pane the one whose view filter and name sort the listing functions
+// use, saving those of the previously active pane.
+void activatePane(const std::shared_ptr<Pane> &pane);
+
+// Runs derive with pane's view filter and name sort in effect, restoring
+// the active pane's afterwards.
+void withPaneView(Pane &pane, const std::function<void()> &derive);
+
+// Re-derives the listing after a view filter or sort change, or rereads it
+// after the directory changed on disk. The cursor stays on the same entry at
+// the same screen row; if the entry is gone, on the row it was at.
+void reapplyView(Pane &pane, bool reread = false);
+
+// Rebuilds what is derived from currentFiles: the name index and, while a
+// search is active, its matches. Called wherever currentFiles is replaced.
+void listingReplaced(Pane &pane);
+
+// The row of name in pane.currentFiles, or -1. Looked up in the name index,
+// so currentFiles must not have been replaced since listingReplaced.
+int rowOf(Pane &pane, const std::string &name);
+
+// Puts the cursor on row, offset rows below the top of the screen where
+// the listing allows, and the search status on the match there, if any.
+void placeCursor(Pane &pane, int row, int offset);
+
+// Remembers the cursor, sort and filter of the active pane's directory.
+void saveViewState(Pane &pane);
+
+// After the active pane moved to a new directory: brings back the sort,
+// filter and cursor it had there. A directory never visited keeps the
+// current sort and filter, with the cursor on fallbackName if it is listed
+// (the directory just left, when going up).
+void restoreViewState(Pane &pane, const std::string &fallbackName = "");
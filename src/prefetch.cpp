@@ -0,0 +1,213 @@
+#include "prefetch.h"
+#include "safeio.h"
+#include <atomic>
+#include <condition_variable>
+#include <iterator>
+#include <list>
+#include <mutex>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace {
+
+struct timespec statMtime(const struct stat &st) {
+#ifdef __APPLE__
+  return st.st_mtimespec;
+#else
+  return st.st_mtim;
+#endif
+}
+
+bool sameTime(const struct timespec &a, const struct timespec &b) {
+  return a.tv_sec == b.tv_sec && a.tv_nsec == b.tv_nsec;
+}
+
+} // namespace
+
+struct PrefetchedListing {
+  std::string path;
+  struct timespec dirMtime;
+  bool stale = false; // Changed (or lost its watch) since it was read
+  std::vector<FileEntry> entries;
+};
+
+// Shared with the worker thread, which may outlive the prefetcher if it is
+// stuck in a slow readdir when peek exits, and with the guarded scans it
+// starts.
+struct DirectoryPrefetcher::State
+    : std::enable_shared_from_this<DirectoryPrefetcher::State> {
+  std::mutex mutex;
+  std::condition_variable wake;
+  bool stopping = false;
+
+  std::string pending;  // Next path to load, empty if none
+  std::string inFlight; // Path being scanned right now
+  bool inFlightStale = false;
+  std::atomic<bool> cancelInFlight{false};
+
+  size_t maxDirectories;
+  size_t maxTotalEntries;
+  size_t totalEntries = 0;
+  std::list<PrefetchedListing> cache; // Most recently used first
+  std::function<void(const std::string &)> ready;
+
+  std::list<PrefetchedListing>::iterator find(const std::string &path) {
+    for (auto it = cache.begin(); it != cache.end(); ++it) {
+      if (it->path == path)
+        return it;
+    }
+    return cache.end();
+  }
+
+  void erase(std::list<PrefetchedListing>::iterator it) {
+    totalEntries -= it->entries.size();
+    cache.erase(it);
+  }
+
+  void insert(PrefetchedListing listing) {
+    auto existing = find(listing.path);
+    if (existing != cache.end())
+      erase(existing);
+    totalEntries += listing.entries.size();
+    cache.push_front(std::move(listing));
+    while (cache.size() > 1 && (cache.size() > maxDirectories ||
+                                totalEntries > maxTotalEntries)) {
+      erase(std::prev(cache.end()));
+    }
+  }
+
+  void run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+      wake.wait(lock, [this] { return stopping || !pending.empty(); });
+      if (stopping)
+        return;
+      inFlight.swap(pending);
+      pending.clear();
+      inFlightStale = false;
+      cancelInFlight = false;
+      std::string path = inFlight;
+      lock.unlock();
+
+      // Under the I/O deadline, so a hung mount under the cursor costs one
+      // deadline and the next request is served by another I/O worker
+      auto listing = std::make_shared<PrefetchedListing>();
+      listing->path = path;
+      auto scanned = std::make_shared<bool>(false);
+      bool finished = runWithDeadline(path, [self = shared_from_this(),
+                                             listing, scanned]() {
+        struct stat dirSt;
+        if (stat(listing->path.c_str(), &dirSt) != 0)
+          return;
+        listing->dirMtime = statMtime(dirSt);
+        // Listings that would blow the whole budget are abandoned early
+        std::vector<FileEntry> &entries = listing->entries;
+        size_t limit = self->maxTotalEntries;
+        *scanned = scanDirectory(
+            listing->path,
+            [&](const char *name, const struct stat &st, bool isLink) {
+              entries.emplace_back(name, st, isLink);
+              if (entries.size() >= limit)
+                self->cancelInFlight = true;
+            },
+            &getScanMatcher(), &self->cancelInFlight);
+      });
+
+      lock.lock();
+      listing->stale = inFlightStale;
+      inFlight.clear();
+      if (finished && *scanned && !cancelInFlight) {
+        insert(std::move(*listing));
+        if (ready) {
+          auto notify = ready;
+          lock.unlock();
+          notify(path);
+          lock.lock();
+        }
+      }
+    }
+  }
+};
+
+DirectoryPrefetcher::DirectoryPrefetcher(size_t maxDirectories,
+                                         size_t maxTotalEntries)
+    : state(std::make_shared<State>()) {
+  state->maxDirectories = maxDirectories;
+  state->maxTotalEntries = maxTotalEntries;
+  std::thread([s = state]() { s->run(); }).detach();
+}
+
+DirectoryPrefetcher::~DirectoryPrefetcher() {
+  std::lock_guard<std::mutex> lock(state->mutex);
+  state->stopping = true;
+  state->cancelInFlight = true;
+  state->wake.notify_all();
+}
+
+void DirectoryPrefetcher::request(const std::string &path) {
+  std::lock_guard<std::mutex> lock(state->mutex);
+  if (state->inFlight == path && !state->inFlightStale)
+    return;
+  auto cached = state->find(path);
+  if (cached != state->cache.end() && !cached->stale)
+    return;
+  if (!state->inFlight.empty())
+    state->cancelInFlight = true;
+  state->pending = path;
+  state->wake.notify_one();
+}
+
+void DirectoryPrefetcher::cancel() {
+  std::lock_guard<std::mutex> lock(state->mutex);
+  state->pending.clear();
+  if (!state->inFlight.empty())
+    state->cancelInFlight = true;
+}
+
+void DirectoryPrefetcher::invalidate(const std::string &path) {
+  std::lock_guard<std::mutex> lock(state->mutex);
+  auto cached = state->find(path);
+  if (cached != state->cache.end())
+    cached->stale = true;
+  if (state->inFlight == path)
+    state->inFlightStale = true;
+}
+
+bool DirectoryPrefetcher::take(const std::string &path,
+                               std::vector<FileEntry> &raw) {
+  struct stat dirSt;
+  bool statOk = statWithDeadline(path, dirSt) == IoStatus::Ok;
+
+  std::lock_guard<std::mutex> lock(state->mutex);
+  auto it = state->find(path);
+  if (it == state->cache.end())
+    return false;
+  // The mtime misses files written in place; the watch catches those
+  bool current = statOk && !it->stale &&
+                 sameTime(statMtime(dirSt), it->dirMtime);
+  if (current)
+    raw = std::move(it->entries);
+  state->erase(it);
+  return current;
+}
+
+void DirectoryPrefetcher::setReadyCallback(
+    std::function<void(const std::string &path)> ready) {
+  std::lock_guard<std::mutex> lock(state->mutex);
+  state->ready = std::move(ready);
+}
+
+bool DirectoryPrefetcher::peek(const std::string &path,
+                               std::vector<FileEntry> &raw) {
+  std::lock_guard<std::mutex> lock(state->mutex);
+  auto it = state->find(path);
+  if (it == state->cache.end())
+    return false;
+  // Move to the front so the previewed listing is evicted last
+  state->cache.splice(state->cache.begin(), state->cache, it);
+  raw = it->entries;
+  return true;
+}
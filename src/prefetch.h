@@ -0,0 +1,51 @@
+#pragma once
+
+#include "utils.h"
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Loads the listing of the directory under the cursor on a background thread
+// so entering it can swap in a ready result instead of scanning.
+//
+// Only the most recent request is kept: while the cursor keeps moving, each
+// new request replaces the pending one and cancels the scan in flight, so
+// fast scrolling never queues up disk work. Finished listings are kept in a
+// small LRU bounded by directory count and total entries; a directory with
+// maxTotalEntries or more entries is never prefetched.
+//
+// A listing is only trusted while its directory is watched: the caller
+// watches the directory it requests and calls invalidate when the watch
+// reports a change or is dropped.
+class DirectoryPrefetcher {
+public:
+  DirectoryPrefetcher(size_t maxDirectories = 16,
+                      size_t maxTotalEntries = 200000);
+  ~DirectoryPrefetcher();
+
+  DirectoryPrefetcher(const DirectoryPrefetcher &) = delete;
+  DirectoryPrefetcher &operator=(const DirectoryPrefetcher &) = delete;
+
+  // Schedules path unless a current listing of it is cached or being loaded.
+  void request(const std::string &path);
+  // Drops the pending request and abandons the scan in flight.
+  void cancel();
+  // Marks the listing of path (cached or being loaded) as out of date, so
+  // take refuses it and the next request reads it again.
+  void invalidate(const std::string &path);
+
+  // Moves the cached listing of path into raw if it is still current: not
+  // invalidated and the directory's mtime is unchanged. Returns false on a
+  // miss.
+  bool take(const std::string &path, std::vector<FileEntry> &raw);
+  // Copies the cached listing of path for display without consuming it.
+  bool peek(const std::string &path, std::vector<FileEntry> &raw);
+
+  // Called on the worker thread after a listing lands in the cache.
+  void setReadyCallback(std::function<void(const std::string &path)> ready);
+
+private:
+  struct State;
+  std::shared_ptr<State> state;
+};
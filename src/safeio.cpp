@@ -0,0 +1,259 @@
+#include "safeio.h"
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#ifdef __APPLE__
+#include <sys/mount.h>
+#include <sys/param.h>
+#else
+#include <mntent.h>
+#endif
+
+namespace {
+
+// Workers beyond this many would all be stuck; calls then wait in the queue
+const int MAX_WORKERS = 16;
+// Idle workers exit after this long
+const auto WORKER_IDLE_EXIT = std::chrono::seconds(30);
+// How long resolving the parent of a path that missed its deadline may take
+const auto RESOLVE_PARENT_TIMEOUT = std::chrono::milliseconds(100);
+
+struct Call {
+  std::function<void()> op;
+  std::atomic<unsigned> progress{0};
+  bool done = false;
+  std::string stuckMount; // Set when the caller gave up waiting
+};
+
+// Never destroyed: workers stuck in a syscall may still be running when the
+// process exits
+struct Pool {
+  std::mutex mutex;
+  std::condition_variable queued;
+  std::condition_variable finished;
+  std::deque<std::shared_ptr<Call>> calls;
+  int workers = 0;
+  int idleWorkers = 0;
+  // Mount point -> calls on it still running past their deadline
+  std::unordered_map<std::string, int> stuckMounts;
+  std::function<void(const std::string &)> recovered;
+};
+
+Pool &pool() {
+  static Pool *instance = new Pool;
+  return *instance;
+}
+
+thread_local std::atomic<unsigned> *activeProgress = nullptr;
+
+bool isUnder(const std::string &path, const std::string &mount) {
+  if (mount == "/")
+    return !path.empty() && path[0] == '/';
+  return path.compare(0, mount.size(), mount) == 0 &&
+         (path.size() == mount.size() || path[mount.size()] == '/');
+}
+
+// path with its parent directory resolved by realpath(3), so symlinks and
+// ".." no longer hide which mount it is on; "" if that fails. The parent was
+// usually just listed, but in case it hangs too it is resolved on a thread
+// of its own and given up on after a short wait.
+std::string resolveParent(const std::string &path) {
+  size_t slash = path.find_last_of('/');
+  std::string parent = slash == std::string::npos ? "."
+                       : slash == 0               ? "/"
+                                                  : path.substr(0, slash);
+  std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+  if (name.empty() || name == "." || name == "..") {
+    parent = path;
+    name.clear();
+  }
+
+  struct Resolved {
+    std::mutex mutex;
+    std::condition_variable done;
+    bool finished = false;
+    std::string path;
+  };
+  auto resolved = std::make_shared<Resolved>();
+  std::thread([parent, resolved]() {
+    char buffer[PATH_MAX];
+    std::string result;
+    if (realpath(parent.c_str(), buffer))
+      result = buffer;
+    std::lock_guard<std::mutex> lock(resolved->mutex);
+    resolved->path = std::move(result);
+    resolved->finished = true;
+    resolved->done.notify_all();
+  }).detach();
+
+  std::unique_lock<std::mutex> lock(resolved->mutex);
+  if (!resolved->done.wait_for(lock, RESOLVE_PARENT_TIMEOUT,
+                               [&resolved]() { return resolved->finished; }) ||
+      resolved->path.empty())
+    return "";
+  if (name.empty())
+    return resolved->path;
+  return resolved->path == "/" ? "/" + name : resolved->path + "/" + name;
+}
+
+// The longest mount point that is a prefix of path once its parent is
+// resolved, read from the mount table without touching any of the mounted
+// filesystems. A path that can't be resolved blames just itself rather
+// than whatever mount its spelling happens to start with.
+std::string mountPointOf(const std::string &requested) {
+  std::string path = resolveParent(requested);
+  if (path.empty())
+    return requested;
+  std::string best;
+  auto consider = [&](const char *mount) {
+    std::string candidate = mount;
+    if (candidate.size() > best.size() && isUnder(path, candidate))
+      best = candidate;
+  };
+#ifdef __APPLE__
+  struct statfs *mounts;
+  int count = getmntinfo(&mounts, MNT_NOWAIT);
+  for (int i = 0; i < count; ++i)
+    consider(mounts[i].f_mntonname);
+#else
+  FILE *table = setmntent("/proc/self/mounts", "r");
+  if (table) {
+    while (struct mntent *mount = getmntent(table))
+      consider(mount->mnt_dir);
+    endmntent(table);
+  }
+#endif
+  // No table: blame just the path
+  return best.empty() ? requested : best;
+}
+
+std::string stuckMountLocked(const Pool &p, const std::string &path) {
+  for (const auto &stuck : p.stuckMounts) {
+    if (isUnder(path, stuck.first))
+      return stuck.first;
+  }
+  return "";
+}
+
+void workerLoop() {
+  Pool &p = pool();
+  std::unique_lock<std::mutex> lock(p.mutex);
+  while (true) {
+    p.idleWorkers++;
+    bool woken = p.queued.wait_for(lock, WORKER_IDLE_EXIT,
+                                   [&p]() { return !p.calls.empty(); });
+    p.idleWorkers--;
+    if (!woken) {
+      p.workers--;
+      return;
+    }
+    std::shared_ptr<Call> call = std::move(p.calls.front());
+    p.calls.pop_front();
+    lock.unlock();
+
+    activeProgress = &call->progress;
+    call->op();
+    activeProgress = nullptr;
+    call->op = nullptr; // Drop its captures before taking the lock
+
+    lock.lock();
+    call->done = true;
+    p.finished.notify_all();
+    if (!call->stuckMount.empty() && --p.stuckMounts[call->stuckMount] == 0) {
+      p.stuckMounts.erase(call->stuckMount);
+      auto recovered = p.recovered;
+      if (recovered) {
+        lock.unlock();
+        recovered(call->stuckMount);
+        lock.lock();
+      }
+    }
+  }
+}
+
+} // namespace
+
+bool runWithDeadline(const std::string &path, std::function<void()> op,
+                     int deadlineMs) {
+  Pool &p = pool();
+  auto call = std::make_shared<Call>();
+  call->op = std::move(op);
+
+  std::unique_lock<std::mutex> lock(p.mutex);
+  if (!stuckMountLocked(p, path).empty())
+    return false;
+  p.calls.push_back(call);
+  // A worker stuck in a syscall is never idle, so new calls get their own
+  if ((int)p.calls.size() > p.idleWorkers && p.workers < MAX_WORKERS) {
+    p.workers++;
+    std::thread(workerLoop).detach();
+  } else {
+    p.queued.notify_one();
+  }
+
+  auto window = std::chrono::milliseconds(deadlineMs);
+  auto deadline = std::chrono::steady_clock::now() + window;
+  unsigned seen = 0;
+  while (!call->done) {
+    if (p.finished.wait_until(lock, deadline) != std::cv_status::timeout)
+      continue;
+    unsigned progress = call->progress.load(std::memory_order_relaxed);
+    if (call->done || progress == seen)
+      break;
+    seen = progress;
+    deadline = std::chrono::steady_clock::now() + window;
+  }
+  if (call->done)
+    return true;
+
+  // Resolving the path may take a moment; other calls needn't wait on it
+  lock.unlock();
+  std::string mount = mountPointOf(path);
+  lock.lock();
+  if (call->done)
+    return true;
+  call->stuckMount = mount;
+  p.stuckMounts[call->stuckMount]++;
+  return false;
+}
+
+void noteIoProgress() {
+  if (activeProgress)
+    activeProgress->fetch_add(1, std::memory_order_relaxed);
+}
+
+IoStatus statWithDeadline(const std::string &path, struct stat &st) {
+  struct Result {
+    int status = -1;
+    struct stat st;
+  };
+  auto result = std::make_shared<Result>();
+  if (!runWithDeadline(path, [path, result]() {
+        result->status = stat(path.c_str(), &result->st);
+      }))
+    return IoStatus::Unresponsive;
+  if (result->status != 0)
+    return IoStatus::Failed;
+  st = result->st;
+  return IoStatus::Ok;
+}
+
+std::string unresponsiveMount(const std::string &path) {
+  Pool &p = pool();
+  std::lock_guard<std::mutex> lock(p.mutex);
+  return stuckMountLocked(p, path);
+}
+
+void setIoRecoveredCallback(
+    std::function<void(const std::string &mount)> cb) {
+  Pool &p = pool();
+  std::lock_guard<std::mutex> lock(p.mutex);
+  p.recovered = std::move(cb);
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <sys/stat.h>
+
+// Filesystem calls made for the UI run on a small pool of I/O workers and
+// are waited for with a deadline, so a stale NFS or FUSE mount (where a stat
+// or readdir can sleep forever) costs the UI one deadline instead of the
+// whole terminal.
+//
+// When a call misses its deadline, the mount holding its path is marked
+// unresponsive until that call returns. Meanwhile every guarded call under
+// the mount fails at once without being run, and work elsewhere gets a fresh
+// worker rather than queueing behind the stuck one.
+
+// How long the UI waits on a call that has stopped making progress
+const int IO_DEADLINE_MS = 2000;
+
+enum class IoStatus { Ok, Failed, Unresponsive };
+
+// Runs op on an I/O worker and waits for it. Returns false if path's mount
+// is already unresponsive (op is not run) or if op misses the deadline; op
+// then keeps running on its worker and its result is dropped, so it must
+// only touch state it owns (captured by value or shared_ptr).
+//
+// The deadline counts from op's last call to noteIoProgress, so a long scan
+// of a large but healthy directory is never cut off.
+bool runWithDeadline(const std::string &path, std::function<void()> op,
+                     int deadlineMs = IO_DEADLINE_MS);
+
+// Called by long operations (once per directory entry, say) to push back
+// the deadline of the guarded call running them. Does nothing elsewhere.
+void noteIoProgress();
+
+// stat(2) under the deadline.
+IoStatus statWithDeadline(const std::string &path, struct stat &st);
+
+// The unresponsive mount point holding path, or "" if there is none.
+std::string unresponsiveMount(const std::string &path);
+
+// Called on the worker thread when the last stuck call on a mount returns
+// and the mount is usable again.
+void setIoRecoveredCallback(std::function<void(const std::string &mount)> cb);
@@ -0,0 +1,219 @@
+#include "sniff.h"
+#include "safeio.h"
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <fcntl.h>
+#include <mutex>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace {
+
+// Workers reading files at once; more would only queue on the same disk
+const unsigned MAX_SNIFF_WORKERS = 4;
+
+bool startsWith(const unsigned char *data, size_t len, const char *magic,
+                size_t magicLen) {
+  return len >= magicLen && memcmp(data, magic, magicLen) == 0;
+}
+
+bool looksLikeText(const unsigned char *data, size_t len) {
+  size_t i = 0;
+  while (i < len) {
+    unsigned char c = data[i];
+    if (c < 0x80) {
+      // Tab, newline, vertical tab, form feed, carriage return, backspace
+      // and escape (colored logs) are common in text; other controls aren't
+      bool allowed = (c >= 0x20 && c != 0x7f) || (c >= '\b' && c <= '\r') ||
+                     c == 0x1b;
+      if (!allowed)
+        return false;
+      i++;
+      continue;
+    }
+    size_t extra = c >= 0xc2 && c <= 0xdf   ? 1
+                   : c >= 0xe0 && c <= 0xef ? 2
+                   : c >= 0xf0 && c <= 0xf4 ? 3
+                                            : 0;
+    if (extra == 0)
+      return false;
+    for (size_t k = 1; k <= extra; ++k) {
+      if (i + k == len)
+        return true; // Cut off by the buffer, not malformed
+      if ((data[i + k] & 0xc0) != 0x80)
+        return false;
+    }
+    i += extra + 1;
+  }
+  return true;
+}
+
+// What a file is remembered by: it is sniffed again once it changes
+struct SniffKey {
+  dev_t dev;
+  ino_t ino;
+  time_t mtime;
+  off_t size;
+
+  bool operator==(const SniffKey &other) const {
+    return dev == other.dev && ino == other.ino && mtime == other.mtime &&
+           size == other.size;
+  }
+};
+
+struct SniffKeyHash {
+  size_t operator()(const SniffKey &key) const {
+    size_t hash = std::hash<ino_t>()(key.ino);
+    hash = hash * 31 + std::hash<dev_t>()(key.dev);
+    hash = hash * 31 + std::hash<time_t>()(key.mtime);
+    return hash * 31 + std::hash<off_t>()(key.size);
+  }
+};
+
+SniffKey keyOf(const EntryStat &meta) {
+  return {meta.dev, meta.ino, meta.mtime, meta.size};
+}
+
+} // namespace
+
+ContentKind sniffContent(const unsigned char *data, size_t len) {
+  if (len == 0)
+    return ContentKind::Unknown;
+  if (startsWith(data, len, "\x7f"
+                            "ELF",
+                 4) ||
+      startsWith(data, len, "\xfe\xed\xfa\xce", 4) ||
+      startsWith(data, len, "\xfe\xed\xfa\xcf", 4) ||
+      startsWith(data, len, "\xce\xfa\xed\xfe", 4) ||
+      startsWith(data, len, "\xcf\xfa\xed\xfe", 4) ||
+      startsWith(data, len, "\xca\xfe\xba\xbe", 4)) // Universal binary
+    return ContentKind::Executable;
+  if (startsWith(data, len, "#!", 2))
+    return ContentKind::Script;
+  if (startsWith(data, len, "\x1f\x8b", 2) ||
+      startsWith(data, len, "\x28\xb5\x2f\xfd", 4) ||
+      startsWith(data, len, "PK\x03\x04", 4) ||
+      startsWith(data, len, "PK\x05\x06", 4)) // Empty zip
+    return ContentKind::Archive;
+  if (startsWith(data, len, "\x89PNG\r\n\x1a\n", 8))
+    return ContentKind::Image;
+  return looksLikeText(data, len) ? ContentKind::Text : ContentKind::Binary;
+}
+
+// Shared with the workers, which may outlive the sniffer while a read on a
+// slow mount finishes.
+struct ContentSniffer::State {
+  std::mutex mutex;
+  std::condition_variable wake;
+  bool stopping = false;
+
+  std::vector<SniffTarget> pending; // Taken from the back
+  std::unordered_set<SniffKey, SniffKeyHash> inFlight;
+  int busy = 0;
+
+  size_t maxRemembered;
+  std::unordered_map<SniffKey, ContentKind, SniffKeyHash> kinds;
+  std::function<void()> ready;
+
+  void run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+      wake.wait(lock, [this] { return stopping || !pending.empty(); });
+      if (stopping)
+        return;
+      SniffTarget target = std::move(pending.back());
+      pending.pop_back();
+      SniffKey key = keyOf(target.meta);
+      inFlight.insert(key);
+      busy++;
+      lock.unlock();
+
+      ContentKind kind = sniffFile(target.path);
+
+      lock.lock();
+      busy--;
+      inFlight.erase(key);
+      // The visible rows are requested again, so forgetting everything
+      // costs one more read of those
+      if (kinds.size() >= maxRemembered)
+        kinds.clear();
+      kinds[key] = kind;
+      if (pending.empty() && busy == 0 && ready) {
+        auto notify = ready;
+        lock.unlock();
+        notify();
+        lock.lock();
+      }
+    }
+  }
+
+  static ContentKind sniffFile(const std::string &path) {
+    struct Head {
+      unsigned char bytes[SNIFF_BYTES];
+      size_t len = 0;
+    };
+    auto head = std::make_shared<Head>();
+    bool finished = runWithDeadline(path, [path, head]() {
+      // Nonblocking so a FIFO that replaced the file can't hold the open
+      int fd = open(path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+      if (fd < 0)
+        return;
+      while (head->len < SNIFF_BYTES) {
+        ssize_t n = read(fd, head->bytes + head->len, SNIFF_BYTES - head->len);
+        if (n <= 0)
+          break;
+        head->len += n;
+      }
+      close(fd);
+    });
+    if (!finished)
+      return ContentKind::Unknown;
+    return sniffContent(head->bytes, head->len);
+  }
+};
+
+ContentSniffer::ContentSniffer(size_t maxRemembered)
+    : state(std::make_shared<State>()) {
+  state->maxRemembered = maxRemembered;
+  unsigned workers = std::max(
+      1u, std::min(MAX_SNIFF_WORKERS, std::thread::hardware_concurrency()));
+  for (unsigned i = 0; i < workers; ++i)
+    std::thread([s = state]() { s->run(); }).detach();
+}
+
+ContentSniffer::~ContentSniffer() {
+  std::lock_guard<std::mutex> lock(state->mutex);
+  state->stopping = true;
+  state->wake.notify_all();
+}
+
+void ContentSniffer::request(const std::vector<SniffTarget> &targets) {
+  std::lock_guard<std::mutex> lock(state->mutex);
+  state->pending.clear();
+  for (auto it = targets.rbegin(); it != targets.rend(); ++it) {
+    SniffKey key = keyOf(it->meta);
+    if (state->kinds.count(key) || state->inFlight.count(key) ||
+        !unresponsiveMount(it->path).empty())
+      continue;
+    state->pending.push_back(*it); // Reversed, so the top row goes first
+  }
+  if (!state->pending.empty())
+    state->wake.notify_all();
+}
+
+bool ContentSniffer::lookup(const EntryStat &meta, ContentKind &kind) const {
+  std::lock_guard<std::mutex> lock(state->mutex);
+  auto it = state->kinds.find(keyOf(meta));
+  if (it == state->kinds.end())
+    return false;
+  kind = it->second;
+  return true;
+}
+
+void ContentSniffer::setReadyCallback(std::function<void()> ready) {
+  std::lock_guard<std::mutex> lock(state->mutex);
+  state->ready = std::move(ready);
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "utils.h"
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+// What the first bytes of a file say it is, for files whose name doesn't.
+enum class ContentKind {
+  Unknown, // Not sniffed yet, empty, or unreadable
+  Executable, // ELF or Mach-O
+  Script,     // Starts with #!
+  Archive,    // gzip, zstd or zip
+  Image,      // PNG
+  Text,       // Valid UTF-8 without control characters
+  Binary,
+};
+
+// Bytes read from the start of each file
+const size_t SNIFF_BYTES = 512;
+
+// Classifies the first len bytes of a file. A multibyte UTF-8 sequence cut
+// off by the end of the buffer still counts as text.
+ContentKind sniffContent(const unsigned char *data, size_t len);
+
+// A regular file to sniff, identified by the stat it was listed with.
+struct SniffTarget {
+  std::string path;
+  EntryStat meta;
+};
+
+// Sniffs files on a few background workers and remembers the result per
+// inode and mtime, so a file is read once however often it is drawn and
+// whichever pane shows it.
+//
+// Only the latest batch is kept: each request replaces the files still
+// waiting, so scrolling past a directory of thousands of files only ever
+// reads the ones that were on screen. Each read runs under the I/O deadline
+// (see safeio.h); files on an unresponsive mount are skipped.
+class ContentSniffer {
+public:
+  ContentSniffer(size_t maxRemembered = 65536);
+  ~ContentSniffer();
+
+  ContentSniffer(const ContentSniffer &) = delete;
+  ContentSniffer &operator=(const ContentSniffer &) = delete;
+
+  // Replaces the pending batch with the targets not yet known or in flight.
+  void request(const std::vector<SniffTarget> &targets);
+
+  // The remembered kind of the file meta describes; false if it hasn't been
+  // sniffed (or has changed since).
+  bool lookup(const EntryStat &meta, ContentKind &kind) const;
+
+  // Called on a worker thread once the pending batch has been sniffed.
+  void setReadyCallback(std::function<void()> ready);
+
+private:
+  struct State;
+  std::shared_ptr<State> state;
+};
@@ -0,0 +1,132 @@
+#include "sort.h"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <string>
+#include <vector>
+
+const char *nameSortLabel(NameSort mode) {
+  switch (mode) {
+  case NameSort::None:
+    return "directory order";
+  case NameSort::Byte:
+    return "name";
+  case NameSort::CaseInsensitive:
+    return "name (ignore case)";
+  case NameSort::Natural:
+    return "natural";
+  case NameSort::Locale:
+    return "locale";
+  }
+  return "";
+}
+
+NameSort nextNameSort(NameSort mode) {
+  switch (mode) {
+  case NameSort::None:
+    return NameSort::Byte;
+  case NameSort::Byte:
+    return NameSort::CaseInsensitive;
+  case NameSort::CaseInsensitive:
+    return NameSort::Natural;
+  case NameSort::Natural:
+    return NameSort::Locale;
+  case NameSort::Locale:
+    return NameSort::None;
+  }
+  return NameSort::None;
+}
+
+static void appendNaturalKey(const std::string &name, std::string &key) {
+  size_t i = 0;
+  size_t n = name.size();
+  while (i < n) {
+    unsigned char c = name[i];
+    if (!std::isdigit(c)) {
+      key.push_back(std::tolower(c));
+      ++i;
+      continue;
+    }
+    size_t start = i;
+    while (i < n && std::isdigit((unsigned char)name[i]))
+      ++i;
+    // Leading zeros don't change the value; keep at least one digit
+    while (start + 1 < i && name[start] == '0')
+      ++start;
+    // '0' keeps numbers ordered against text as ASCII digits would be, and
+    // the length byte makes shorter numbers sort first
+    key.push_back('0');
+    key.push_back((char)std::min<size_t>(i - start, 255));
+    key.append(name, start, i - start);
+  }
+}
+
+std::string makeCollationKey(const std::string &name, NameSort mode) {
+  std::string key;
+  switch (mode) {
+  case NameSort::None:
+  case NameSort::Byte:
+    return name;
+  case NameSort::CaseInsensitive:
+    key.reserve(name.size() * 2 + 1);
+    for (unsigned char c : name)
+      key.push_back(std::tolower(c));
+    break;
+  case NameSort::Natural:
+    key.reserve(name.size() * 2 + 8);
+    appendNaturalKey(name, key);
+    break;
+  case NameSort::Locale: {
+    size_t len = strxfrm(nullptr, name.c_str(), 0);
+    key.resize(len + 1);
+    strxfrm(&key[0], name.c_str(), len + 1);
+    key.resize(len);
+    break;
+  }
+  }
+  key.push_back('\0');
+  key += name;
+  return key;
+}
+
+void buildSortKeys(std::vector<FileEntry> &entries, NameSort mode) {
+  if (mode == NameSort::None)
+    return;
+  for (auto &entry : entries) {
+    if (entry.sortKeyMode != (int)mode) {
+      entry.sortKey = makeCollationKey(entry.name, mode);
+      entry.sortKeyMode = (int)mode;
+    }
+  }
+}
+
+void sortByName(std::vector<FileEntry> &entries, NameSort mode) {
+  if (mode == NameSort::None)
+    return;
+  buildSortKeys(entries, mode);
+  std::sort(entries.begin(), entries.end(),
+            [](const FileEntry &a, const FileEntry &b) {
+              return a.sortKey < b.sortKey;
+            });
+}
+
+void sortByModTime(const std::string &currentPath,
+                   std::vector<FileEntry> &currentFiles) {
+  // Times come from each entry's cached stat, not a stat per comparison
+  std::vector<FileEntry *> entries;
+  entries.reserve(currentFiles.size());
+  for (auto &entry : currentFiles)
+    entries.push_back(&entry);
+  loadEntryStats(currentPath, entries);
+  std::sort(currentFiles.begin(), currentFiles.end(),
+            [](const auto &a, const auto &b) {
+              // Directories go last
+              if (a.isDir && !b.isDir)
+                return false;
+              if (!a.isDir && b.isDir)
+                return true;
+
+              // For files, compare modified times
+              return a.meta.mtime > b.meta.mtime; // Newest first
+            });
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "utils.h"
+#include <string>
+#include <vector>
+
+enum class NameSort { None, Byte, CaseInsensitive, Natural, Locale };
+
+const char *nameSortLabel(NameSort mode);
+NameSort nextNameSort(NameSort mode);
+
+// Builds a key whose byte order (memcmp) is the requested name order:
+// lowercase for case-insensitive, length-prefixed digit runs for natural
+// ("part9" < "part10"), strxfrm output for locale collation. The original
+// name is appended after a NUL so ties stay deterministic.
+std::string makeCollationKey(const std::string &name, NameSort mode);
+
+// Makes sure every entry carries a key for mode.
+void buildSortKeys(std::vector<FileEntry> &entries, NameSort mode);
+
+// Sorts by name, (re)building each entry's cached key only if it was made
+// for a different mode. NameSort::None leaves the order untouched.
+void sortByName(std::vector<FileEntry> &entries, NameSort mode);
+
+// Sorts newest file first, directories last (the `m` toggle).
+void sortByModTime(const std::string &currentPath,
+                   std::vector<FileEntry> &currentFiles);
@@ -1,60 +1,544 @@
 #include "utils.h"
+#include "safeio.h"
+#include "sort.h"
+#include <algorithm>
 #include <cstddef>
 #include <cstdio>
 #include <cstring> // For strcmp
+#include <cwchar>
 #include <ctime>
 #include <dirent.h>
+#include <fcntl.h>
 #include <filesystem>
+#include <grp.h>
 #include <iomanip>
 #include <iostream>
+#include <limits.h>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <pwd.h>
 #include <sstream>
 #include <string>
 #include <sys/dirent.h>
 #include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
 namespace fs = std::filesystem;
 
-std::vector<std::pair<std::string, bool>>
-getDirectoryContents(const std::string &path) {
-  std::vector<std::pair<std::string, bool>> contents;
+namespace {
+
+EntryMatcher scanMatcher;
+FilterSpec viewFilterSpec;
+EntryMatcher viewMatcher;
+NameSort nameSort = NameSort::Natural;
+
+// Listings held in the cache that no pane shows any more
+const size_t UNPINNED_LISTINGS = 8;
+
+// Raw (scan-filtered) listings shared by every pane, most recently used
+// first, so view filter toggles are re-applied without another readdir and
+// panes on the same directory never scan it twice. A listing is replaced
+// when its directory is reread; only its sort keys and hasMtime change in
+// place, under the mutex.
+std::mutex listingCacheMutex;
+std::list<std::shared_ptr<DirectoryListing>> listingCache;
+// Directories whose changes are reported by a watch (see
+// setWatchedDirectories); only their listings are reused
+std::vector<std::string> watchedDirectories;
+size_t listingLimit = 0;
+
+std::vector<FileEntry>
+applyMatcher(const EntryMatcher &matcher,
+             const std::vector<FileEntry> &entries) {
+  if (matcher.empty())
+    return entries;
+  std::vector<FileEntry> filtered;
+  filtered.reserve(entries.size());
+  for (const auto &entry : entries) {
+    if (matcher.matches(entry.name.c_str(), entry.isDir))
+      filtered.push_back(entry);
+  }
+  return filtered;
+}
+
+std::list<std::shared_ptr<DirectoryListing>>::iterator
+findListing(const std::string &path) {
+  auto it = listingCache.begin();
+  while (it != listingCache.end() && (*it)->path != path)
+    ++it;
+  if (it != listingCache.end() && it != listingCache.begin())
+    listingCache.splice(listingCache.begin(), listingCache, it);
+  return it == listingCache.end() ? it : listingCache.begin();
+}
+
+// Replaces the listing of its path. Listings a pane still holds are never
+// evicted; of the rest, only the most recent few are kept.
+DirectoryListing &storeListing(std::shared_ptr<DirectoryListing> listing) {
+  auto existing = findListing(listing->path);
+  if (existing != listingCache.end())
+    listingCache.erase(existing);
+  listingCache.push_front(std::move(listing));
+  size_t unpinned = 0;
+  for (auto it = listingCache.begin(); it != listingCache.end();) {
+    if (it->use_count() == 1 && ++unpinned > UNPINNED_LISTINGS)
+      it = listingCache.erase(it);
+    else
+      ++it;
+  }
+  return *listingCache.front();
+}
+
+bool sameMtime(const struct stat &a, const struct timespec &b) {
+#ifdef __APPLE__
+  return a.st_mtimespec.tv_sec == b.tv_sec &&
+         a.st_mtimespec.tv_nsec == b.tv_nsec;
+#else
+  return a.st_mtim.tv_sec == b.tv_sec && a.st_mtim.tv_nsec == b.tv_nsec;
+#endif
+}
+
+} // namespace
+
+FileEntry::FileEntry(std::string name, const struct stat &st, bool isLink)
+    : name(std::move(name)), isDir(S_ISDIR(st.st_mode)) {
+  meta.valid = true;
+  meta.isLink = isLink;
+  meta.mode = st.st_mode;
+  meta.uid = st.st_uid;
+  meta.gid = st.st_gid;
+  meta.links = st.st_nlink;
+  meta.size = st.st_size;
+  meta.mtime = st.st_mtime;
+  meta.dev = st.st_dev;
+  meta.ino = st.st_ino;
+}
+
+bool scanDirectory(
+    const std::string &path,
+    const std::function<void(const char *name, const struct stat &st,
+                             bool isLink)> &visit,
+    const EntryMatcher *matcher, const std::atomic<bool> *cancelled,
+    bool followLinks) {
+  if (matcher && matcher->empty())
+    matcher = nullptr;
   DIR *dir = opendir(path.c_str());
 
   if (dir == NULL) {
     std::string error = "Error opening dir: " + path;
     perror(error.c_str());
-    return contents;
+    return false;
   }
 
+  std::string fullPath = path == "/" ? path : path + "/";
+  size_t baseLen = fullPath.size();
   struct dirent *entry;
   while ((entry = readdir(dir)) != NULL) {
+    noteIoProgress();
+    if (cancelled && cancelled->load(std::memory_order_relaxed)) {
+      closedir(dir);
+      return false;
+    }
     if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) {
-      std::string fullPath = path + "/" + entry->d_name;
+      if (matcher) {
+        if (!matcher->matchesName(entry->d_name))
+          continue;
+        // d_type is free; symlinks and DT_UNKNOWN need the stat to resolve
+        if (entry->d_type == DT_DIR || entry->d_type == DT_REG) {
+          if (!matcher->matchesTyped(entry->d_name, entry->d_type == DT_DIR))
+            continue;
+        }
+      }
+      fullPath.resize(baseLen);
+      fullPath += entry->d_name;
       struct stat buffer;
-      if (stat(fullPath.c_str(), &buffer) == 0) {
-        contents.push_back({entry->d_name, S_ISDIR(buffer.st_mode)});
+      bool isLink = entry->d_type == DT_LNK;
+      bool statted;
+      if (!followLinks) {
+        statted = lstat(fullPath.c_str(), &buffer) == 0;
+        isLink = statted ? S_ISLNK(buffer.st_mode) : isLink;
+      } else {
+        if (entry->d_type == DT_UNKNOWN &&
+            lstat(fullPath.c_str(), &buffer) == 0)
+          isLink = S_ISLNK(buffer.st_mode);
+        statted = stat(fullPath.c_str(), &buffer) == 0;
+      }
+      if (statted) {
+        if (matcher && entry->d_type != DT_DIR && entry->d_type != DT_REG &&
+            !matcher->matchesTyped(entry->d_name, S_ISDIR(buffer.st_mode)))
+          continue;
+        visit(entry->d_name, buffer, isLink);
       }
     }
   }
   closedir(dir);
-  return contents;
+  return true;
+}
+
+// Keys are built on the raw listing so later filter toggles and re-sorts of
+// the cached listing reuse them
+std::vector<FileEntry> deriveDirectoryView(std::vector<FileEntry> &raw) {
+  buildSortKeys(raw, nameSort);
+  std::vector<FileEntry> view = applyMatcher(viewMatcher, raw);
+  sortByName(view, nameSort);
+  return view;
+}
+
+bool readDirectoryContents(const std::string &path,
+                           std::vector<FileEntry> &raw,
+                           const std::atomic<bool> *cancelled) {
+  return scanDirectory(
+      path,
+      [&raw](const char *name, const struct stat &st, bool isLink) {
+        raw.emplace_back(name, st, isLink);
+      },
+      &scanMatcher, cancelled);
+}
+
+std::vector<FileEntry>
+getDirectoryContents(const std::string &path) {
+  // Reuse the shared listing of a watched directory while its mtime says it
+  // is current. Files written in place leave the directory's mtime alone,
+  // so an unwatched directory may have changed and is always read again.
+  struct stat dirSt;
+  bool statOk = statWithDeadline(path, dirSt) == IoStatus::Ok;
+  if (statOk) {
+    std::lock_guard<std::mutex> lock(listingCacheMutex);
+    auto cached = findListing(path);
+    if (cached != listingCache.end() && (*cached)->hasMtime &&
+        sameMtime(dirSt, (*cached)->dirMtime) &&
+        std::find(watchedDirectories.begin(), watchedDirectories.end(),
+                  path) != watchedDirectories.end())
+      return deriveDirectoryView((*cached)->entries);
+  }
+
+  // Owned by the scan, which outlives this call if the mount hangs
+  struct Scan {
+    std::vector<FileEntry> contents;
+    std::atomic<bool> full{false};
+  };
+  auto scan = std::make_shared<Scan>();
+  size_t limit = listingLimit;
+  bool finished = runWithDeadline(path, [path, scan, limit]() {
+    if (limit == 0) {
+      readDirectoryContents(path, scan->contents);
+      return;
+    }
+    // Stop reading as soon as the cap is reached
+    scanDirectory(
+        path,
+        [&](const char *name, const struct stat &st, bool isLink) {
+          scan->contents.emplace_back(name, st, isLink);
+          if (scan->contents.size() >= limit)
+            scan->full = true;
+        },
+        &scanMatcher, &scan->full);
+  });
+
+  // An unresponsive directory is shown empty; unresponsiveMount tells why
+  auto listing = std::make_shared<DirectoryListing>();
+  listing->path = path;
+  if (finished) {
+    listing->entries = std::move(scan->contents);
+    listing->truncated = scan->full;
+    // The stat came before the scan, so a change during it shows as stale
+    listing->hasMtime = statOk;
+#ifdef __APPLE__
+    listing->dirMtime = dirSt.st_mtimespec;
+#else
+    listing->dirMtime = dirSt.st_mtim;
+#endif
+  }
+  std::lock_guard<std::mutex> lock(listingCacheMutex);
+  return deriveDirectoryView(storeListing(std::move(listing)).entries);
+}
+
+void setWatchedDirectories(const std::vector<std::string> &paths) {
+  std::lock_guard<std::mutex> lock(listingCacheMutex);
+  watchedDirectories = paths;
+}
+
+void invalidateDirectoryListing(const std::string &path) {
+  std::lock_guard<std::mutex> lock(listingCacheMutex);
+  auto cached = findListing(path);
+  if (cached != listingCache.end())
+    (*cached)->hasMtime = false;
+}
+
+std::vector<FileEntry>
+refilterDirectoryContents(const std::string &path) {
+  {
+    std::lock_guard<std::mutex> lock(listingCacheMutex);
+    auto cached = findListing(path);
+    if (cached != listingCache.end())
+      return deriveDirectoryView((*cached)->entries);
+  }
+  return getDirectoryContents(path);
+}
+
+std::vector<FileEntry>
+filterDirectoryContents(const std::string &path,
+                        const std::vector<FileEntry> &raw) {
+  auto listing = std::make_shared<DirectoryListing>();
+  listing->path = path;
+  listing->entries = applyMatcher(scanMatcher, raw);
+  std::lock_guard<std::mutex> lock(listingCacheMutex);
+  return deriveDirectoryView(storeListing(std::move(listing)).entries);
+}
+
+std::shared_ptr<const DirectoryListing>
+currentDirectoryListing(const std::string &path) {
+  std::lock_guard<std::mutex> lock(listingCacheMutex);
+  auto cached = findListing(path);
+  if (cached == listingCache.end())
+    return nullptr;
+  return *cached;
+}
+
+void setScanFilter(const FilterSpec &spec) {
+  scanMatcher = EntryMatcher(spec);
 }
 
-std::string getFormattedModTime(const std::string &path) {
-  try {
-    auto ftime = fs::last_write_time(path);
-    auto sctp =
-        std::chrono::time_point_cast<std::chrono::system_clock::duration>(
-            ftime - fs::file_time_type::clock::now() +
-            std::chrono::system_clock::now());
-    std::time_t cftime = std::chrono::system_clock::to_time_t(sctp);
-    std::tm tm = *std::localtime(&cftime);
+void setViewFilter(const FilterSpec &spec) {
+  viewFilterSpec = spec;
+  viewMatcher = EntryMatcher(spec);
+}
+
+const FilterSpec &getViewFilter() { return viewFilterSpec; }
+
+const EntryMatcher &getScanMatcher() { return scanMatcher; }
+
+void setListingLimit(size_t maxEntries) { listingLimit = maxEntries; }
+
+bool isListingTruncated(const std::string &path) {
+  std::lock_guard<std::mutex> lock(listingCacheMutex);
+  auto cached = findListing(path);
+  return cached != listingCache.end() && (*cached)->truncated;
+}
+
+void setNameSort(NameSort mode) { nameSort = mode; }
+
+NameSort getNameSort() { return nameSort; }
+
+void layoutEntryName(FileEntry &entry, int maxColumns) {
+  if (entry.layoutColumns == maxColumns)
+    return;
+  entry.layoutColumns = maxColumns;
+
+  const char *name = entry.name.data();
+  size_t len = entry.name.size();
+  size_t pos = 0;
+  int columns = 0;
+  std::mbstate_t state = std::mbstate_t();
+  while (pos < len) {
+    wchar_t wc;
+    size_t charLen = std::mbrtowc(&wc, name + pos, len - pos, &state);
+    int charColumns;
+    if (charLen == (size_t)-1 || charLen == (size_t)-2 || charLen == 0) {
+      // Invalid or truncated sequence: treat the byte as one column
+      state = std::mbstate_t();
+      charLen = 1;
+      charColumns = 1;
+    } else {
+      charColumns = wcwidth(wc);
+      if (charColumns < 0)
+        charColumns = 1;
+    }
+    if (columns + charColumns > maxColumns)
+      break;
+    columns += charColumns;
+    pos += charLen;
+  }
+  entry.nameBytes = pos;
+  entry.nameColumns = columns;
+}
+
+std::string formatModTime(time_t mtime) {
+  std::tm tm = *std::localtime(&mtime);
+  char buffer[32];
+  size_t len = strftime(buffer, sizeof(buffer), "%b %d %H:%M", &tm);
+  return std::string(buffer, len);
+}
+
+std::string formatSize(uint64_t bytes) {
+  static const char units[] = "BKMGTPE";
+  double value = bytes;
+  int unit = 0;
+  while (value >= 1024 && unit < 6) {
+    value /= 1024;
+    ++unit;
+  }
+  char buffer[32];
+  if (unit == 0)
+    snprintf(buffer, sizeof(buffer), "%lluB", (unsigned long long)bytes);
+  else
+    snprintf(buffer, sizeof(buffer), "%.1f%c", value, units[unit]);
+  return buffer;
+}
+
+void loadEntryStat(const std::string &dirPath, FileEntry &entry) {
+  if (entry.meta.valid)
+    return;
+  std::vector<FileEntry *> missing = {&entry};
+  loadEntryStats(dirPath, missing);
+}
+
+void loadEntryStats(const std::string &dirPath,
+                    const std::vector<FileEntry *> &entries) {
+  // Stat'd together in one guarded call; results land in a copy the
+  // worker owns, in case it is still running when the deadline passes
+  struct Batch {
+    std::vector<std::string> names;
+    std::vector<EntryStat> stats;
+  };
+  auto batch = std::make_shared<Batch>();
+  for (const FileEntry *entry : entries) {
+    if (!entry->meta.valid)
+      batch->names.push_back(entry->name);
+  }
+  if (batch->names.empty())
+    return;
+  bool finished = runWithDeadline(dirPath, [dirPath, batch]() {
+    std::string fullPath = dirPath == "/" ? dirPath : dirPath + "/";
+    size_t baseLen = fullPath.size();
+    for (const std::string &name : batch->names) {
+      noteIoProgress();
+      fullPath.resize(baseLen);
+      fullPath += name;
+      struct stat st;
+      bool isLink = lstat(fullPath.c_str(), &st) == 0 && S_ISLNK(st.st_mode);
+      if (stat(fullPath.c_str(), &st) == 0)
+        batch->stats.push_back(FileEntry(std::string(), st, isLink).meta);
+      else
+        batch->stats.push_back(EntryStat());
+    }
+  });
+  if (!finished)
+    return;
+  size_t next = 0;
+  for (FileEntry *entry : entries) {
+    if (!entry->meta.valid)
+      entry->meta = batch->stats[next++];
+  }
+}
+
+void loadLinkTarget(const std::string &dirPath, FileEntry &entry) {
+  if (entry.linkTargetLoaded || !entry.meta.isLink)
+    return;
+  std::string fullPath =
+      dirPath == "/" ? dirPath + entry.name : dirPath + "/" + entry.name;
+  struct Link {
+    std::string target;
+    EntryStat meta;
+  };
+  auto link = std::make_shared<Link>();
+  if (!runWithDeadline(fullPath, [fullPath, link]() {
+        char buffer[PATH_MAX];
+        ssize_t len = readlink(fullPath.c_str(), buffer, sizeof(buffer));
+        if (len > 0)
+          link->target.assign(buffer, len);
+        struct stat st;
+        if (lstat(fullPath.c_str(), &st) == 0)
+          link->meta = FileEntry(std::string(), st, true).meta;
+      }))
+    return; // Tried again once the mount recovers
+  entry.linkTargetLoaded = true;
+  entry.linkTarget = std::move(link->target);
+  entry.linkMeta = link->meta;
+}
+
+namespace {
+
+std::mutex idNamesMutex;
+std::unordered_map<uid_t, std::string> userNames;
+std::unordered_map<gid_t, std::string> groupNames;
+
+} // namespace
+
+namespace {
+
+// Bytes compared at a time by sameFileContents
+const size_t CONTENT_CHUNK = 64 * 1024;
+
+size_t readFully(int fd, char *buffer, size_t size) {
+  size_t total = 0;
+  while (total < size) {
+    ssize_t n = read(fd, buffer + total, size - total);
+    if (n <= 0)
+      break;
+    total += n;
+  }
+  return total;
+}
+
+} // namespace
+
+bool sameFileContents(const std::string &a, const std::string &b,
+                      const std::atomic<bool> &cancelled) {
+  int fdA = open(a.c_str(), O_RDONLY);
+  if (fdA < 0)
+    return false;
+  int fdB = open(b.c_str(), O_RDONLY);
+  if (fdB < 0) {
+    close(fdA);
+    return false;
+  }
+  std::vector<char> bufferA(CONTENT_CHUNK), bufferB(CONTENT_CHUNK);
+  bool same = true;
+  while (same) {
+    if (cancelled) {
+      same = false;
+      break;
+    }
+    size_t lenA = readFully(fdA, bufferA.data(), CONTENT_CHUNK);
+    size_t lenB = readFully(fdB, bufferB.data(), CONTENT_CHUNK);
+    same = lenA == lenB && memcmp(bufferA.data(), bufferB.data(), lenA) == 0;
+    if (lenA < CONTENT_CHUNK)
+      break;
+  }
+  close(fdA);
+  close(fdB);
+  return same;
+}
+
+const std::string &userName(uid_t uid) {
+  std::lock_guard<std::mutex> lock(idNamesMutex);
+  auto found = userNames.find(uid);
+  if (found != userNames.end())
+    return found->second;
+  struct passwd *pw = getpwuid(uid);
+  return userNames[uid] = pw ? pw->pw_name : std::to_string(uid);
+}
+
+const std::string &groupName(gid_t gid) {
+  std::lock_guard<std::mutex> lock(idNamesMutex);
+  auto found = groupNames.find(gid);
+  if (found != groupNames.end())
+    return found->second;
+  struct group *gr = getgrgid(gid);
+  return groupNames[gid] = gr ? gr->gr_name : std::to_string(gid);
+}
 
-    std::ostringstream oss;
-    oss << std::put_time(&tm, "%b %d %H:%M");
-    return oss.str();
-  } catch (...) {
-    return "";
+std::string formatPermissions(const EntryStat &meta) {
+  std::string perms = "----------";
+  if (meta.isLink)
+    perms[0] = 'l';
+  else if (S_ISDIR(meta.mode))
+    perms[0] = 'd';
+  static const mode_t bits[9] = {S_IRUSR, S_IWUSR, S_IXUSR, S_IRGRP, S_IWGRP,
+                                 S_IXGRP, S_IROTH, S_IWOTH, S_IXOTH};
+  for (int i = 0; i < 9; ++i) {
+    if (meta.mode & bits[i])
+      perms[i + 1] = "rwx"[i % 3];
   }
+  if (meta.mode & S_ISUID)
+    perms[3] = perms[3] == 'x' ? 's' : 'S';
+  if (meta.mode & S_ISGID)
+    perms[6] = perms[6] == 'x' ? 's' : 'S';
+  if (meta.mode & S_ISVTX)
+    perms[9] = perms[9] == 'x' ? 't' : 'T';
+  return perms;
 }
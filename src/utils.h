@@ -1,13 +1,187 @@
 #ifndef UTILS_H
 #define UTILS_H
 
+#include "filter.h"
+#include <atomic>
+#include <cstdint>
 #include <ctime>
+#include <functional>
+#include <memory>
 #include <string>
+#include <sys/stat.h>
 #include <utility>
 #include <vector>
 
-std::vector<std::pair<std::string, bool>>
+enum class NameSort; // sort.h
+
+// Metadata of an entry, kept from the stat taken when its directory was
+// read so rows never stat again while drawing. For a symlink it describes
+// the target, with isLink set.
+struct EntryStat {
+  bool valid = false;
+  bool isLink = false;
+  mode_t mode = 0;
+  uid_t uid = 0;
+  gid_t gid = 0;
+  nlink_t links = 0; // For directories, roughly the number of entries
+  off_t size = 0;
+  time_t mtime = 0;
+  dev_t dev = 0; // Identify the file for caches keyed by inode
+  ino_t ino = 0;
+};
+
+// One row of a directory listing.
+struct FileEntry {
+  FileEntry() = default;
+  FileEntry(std::string name, bool isDir)
+      : name(std::move(name)), isDir(isDir) {}
+  FileEntry(std::string name, const struct stat &st, bool isLink);
+
+  std::string name;
+  bool isDir = false;
+
+  // Filled by the directory scan; entries from elsewhere (the persistent
+  // index, the windowed view) are stat'd on first use by loadEntryStat.
+  // For a symlink this is its target, which icons and sorting go by.
+  EntryStat meta;
+  // A symlink's target and its own lstat, which the detail columns show as
+  // ls -l does; both read on first use by loadLinkTarget
+  std::string linkTarget;
+  EntryStat linkMeta;
+  bool linkTargetLoaded = false;
+
+  // Collation key for the name sort mode in sortKeyMode, built once per entry
+  // so sorting only compares flat byte strings
+  std::string sortKey;
+  int sortKeyMode = -1;
+
+  // Terminal layout of the name for a column budget of layoutColumns: how
+  // many bytes of name fit and how wide they are. See layoutEntryName.
+  int layoutColumns = -1;
+  int nameBytes = 0;
+  int nameColumns = 0;
+};
+
+// The scan-filtered listing of one directory, shared by every pane showing
+// it (see currentDirectoryListing).
+struct DirectoryListing {
+  std::string path;
+  std::vector<FileEntry> entries;
+  bool truncated = false; // Stopped at the listing limit
+  // The directory's mtime before the scan; unset for listings adopted from
+  // elsewhere, which the next getDirectoryContents rereads
+  bool hasMtime = false;
+  struct timespec dirMtime = {0, 0};
+};
+
+// Calls visit(name, st, isLink) for every entry of path (skipping "." and
+// "..") as soon as it is read, so callers can stream results. st describes a
+// symlink's target, and entries whose stat fails (dangling symlinks) are
+// skipped; with followLinks false, st is the lstat of every entry, so none
+// is skipped. Entries rejected by
+// matcher are skipped before they are stat'd when their type is known from
+// readdir. Returns false if the directory could not be opened or the scan
+// was abandoned because *cancelled became true.
+bool scanDirectory(
+    const std::string &path,
+    const std::function<void(const char *name, const struct stat &st,
+                             bool isLink)> &visit,
+    const EntryMatcher *matcher = nullptr,
+    const std::atomic<bool> *cancelled = nullptr, bool followLinks = true);
+
+// Reads path with only the scan filter applied, without touching the cached
+// listing; safe to call from worker threads.
+bool readDirectoryContents(const std::string &path,
+                           std::vector<FileEntry> &raw,
+                           const std::atomic<bool> *cancelled = nullptr);
+
+// Returns the listing of path narrowed by the view filter and sorted by the
+// name sort mode. The shared listing is reused if the directory is watched
+// and its mtime hasn't changed since it was read, so a second pane on a
+// shown directory doesn't scan it again; otherwise path is scanned with the
+// scan filter applied and the result replaces it for every pane. The scan
+// runs under the I/O deadline (see safeio.h); a directory on an
+// unresponsive mount comes back empty.
+std::vector<FileEntry>
 getDirectoryContents(const std::string &path);
 
-std::string getFormattedModTime(const std::string &path);
+// The directories the event loop watches (those of the visible panes). A
+// watch reports files written in place, which leave the directory's mtime
+// alone; other directories are scanned again whenever they are entered.
+void setWatchedDirectories(const std::vector<std::string> &paths);
+
+// Makes the next getDirectoryContents of path scan again; called when its
+// watch reports a change.
+void invalidateDirectoryListing(const std::string &path);
+
+// Re-derives the view of path from its shared listing, without touching the
+// disk if it is cached.
+std::vector<FileEntry>
+refilterDirectoryContents(const std::string &path);
+
+// The shared listing of path, or null if none is cached. A pane holds on to
+// the one its view was derived from: while it does, the listing stays
+// cached, and a different pointer here means another pane reread the
+// directory.
+std::shared_ptr<const DirectoryListing>
+currentDirectoryListing(const std::string &path);
+
+// Applies the view filter and name sort to a listing read with
+// readDirectoryContents (building its sort keys in place).
+std::vector<FileEntry> deriveDirectoryView(std::vector<FileEntry> &raw);
+
+// Adopts a listing of path obtained elsewhere (e.g. the persistent index) as
+// if it had just been read: applies both filters and remembers the result.
+std::vector<FileEntry>
+filterDirectoryContents(const std::string &path,
+                        const std::vector<FileEntry> &raw);
+
+// Caps how many entries getDirectoryContents keeps (0 = unlimited). A
+// directory that hits the cap is reported by isListingTruncated so the UI
+// can switch to a windowed view of it.
+void setListingLimit(size_t maxEntries);
+bool isListingTruncated(const std::string &path);
+
+// Scan filter: set once from the command line, excluded entries are never
+// stored. View filter: toggled interactively, applied to the cached listing.
+void setScanFilter(const FilterSpec &spec);
+void setViewFilter(const FilterSpec &spec);
+const FilterSpec &getViewFilter();
+const EntryMatcher &getScanMatcher();
+
+// Name order applied to every listing handed to the UI (default: natural).
+void setNameSort(NameSort mode);
+NameSort getNameSort();
+
+// Fills entry's cached layout for maxColumns terminal columns, cutting the
+// name on a character boundary and counting wide (CJK, emoji) characters as
+// two columns. Does nothing if the layout is already for maxColumns.
+void layoutEntryName(FileEntry &entry, int maxColumns);
+
+// Stats entry (in directory dirPath) if the scan didn't already. Both run
+// under the I/O deadline (see safeio.h) and leave meta invalid on a mount
+// that doesn't respond.
+void loadEntryStat(const std::string &dirPath, FileEntry &entry);
+// Same for many entries, stat'd together in one guarded call.
+void loadEntryStats(const std::string &dirPath,
+                    const std::vector<FileEntry *> &entries);
+// Reads a symlink entry's target and lstats the link itself, once.
+void loadLinkTarget(const std::string &dirPath, FileEntry &entry);
+
+// Byte comparison of two files, in chunks; files that can't be read, or
+// differ in length, are not the same. Gives up (false) once cancelled.
+bool sameFileContents(const std::string &a, const std::string &b,
+                      const std::atomic<bool> &cancelled);
+
+// Owner and group names, resolved once per id for the whole process so a
+// listing with many owners costs one lookup each. Unknown ids are shown as
+// numbers.
+const std::string &userName(uid_t uid);
+const std::string &groupName(gid_t gid);
+
+std::string formatModTime(time_t mtime);
+// Human-readable size with one decimal above a kilobyte, e.g. "4.2M"
+std::string formatSize(uint64_t bytes);
+// "drwxr-xr-x"-style permissions, with 'l' for symlinks
+std::string formatPermissions(const EntryStat &meta);
 #endif // UTILS_H
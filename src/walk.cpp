@@ -0,0 +1,100 @@
+#include "walk.h"
+#include <algorithm>
+#include <cstring>
+#include <dirent.h>
+#include <sys/dirent.h>
+#include <thread>
+#include <vector>
+
+bool walkTree(
+    const std::string &root, const EntryMatcher *matcher,
+    const std::function<void(const std::string &path, const struct stat &st)>
+        &visit,
+    const std::atomic<bool> *cancelled) {
+  if (matcher && matcher->empty())
+    matcher = nullptr;
+  struct stat rootStat;
+  if (stat(root.c_str(), &rootStat) != 0 || !S_ISDIR(rootStat.st_mode))
+    return true;
+
+  // Depth-first with an explicit stack so deep trees can't overflow
+  std::vector<std::string> pending{root};
+  std::string fullPath;
+  while (!pending.empty()) {
+    std::string dirPath = std::move(pending.back());
+    pending.pop_back();
+    DIR *dir = opendir(dirPath.c_str());
+    if (dir == NULL)
+      continue; // Unreadable subdirectories are skipped silently
+    struct stat dirStat;
+    if (fstat(dirfd(dir), &dirStat) != 0 ||
+        dirStat.st_dev != rootStat.st_dev) {
+      closedir(dir); // A mount point
+      continue;
+    }
+
+    fullPath = dirPath == "/" ? dirPath : dirPath + "/";
+    size_t baseLen = fullPath.size();
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+      if (cancelled && cancelled->load(std::memory_order_relaxed)) {
+        closedir(dir);
+        return false;
+      }
+      if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+        continue;
+      if (entry->d_type == DT_LNK)
+        continue;
+      if (matcher && !matcher->matchesName(entry->d_name))
+        continue;
+      fullPath.resize(baseLen);
+      fullPath += entry->d_name;
+
+      if (entry->d_type == DT_DIR) {
+        if (!matcher || matcher->matchesTyped(entry->d_name, true))
+          pending.push_back(fullPath);
+        continue;
+      }
+      if (matcher && entry->d_type == DT_REG &&
+          !matcher->matchesTyped(entry->d_name, false))
+        continue;
+
+      struct stat st;
+      if (lstat(fullPath.c_str(), &st) != 0 || st.st_dev != rootStat.st_dev)
+        continue;
+      if (S_ISDIR(st.st_mode)) {
+        // DT_UNKNOWN on filesystems that don't fill in d_type
+        if (!matcher || matcher->matchesTyped(entry->d_name, true))
+          pending.push_back(fullPath);
+      } else if (S_ISREG(st.st_mode)) {
+        if (!matcher || matcher->matchesTyped(entry->d_name, false))
+          visit(fullPath, st);
+      }
+    }
+    closedir(dir);
+  }
+  return true;
+}
+
+void runParallel(size_t count, const std::function<void(size_t i)> &work) {
+  size_t threadCount = std::max(1u, std::thread::hardware_concurrency());
+  threadCount = std::min(threadCount, count);
+  if (threadCount <= 1) {
+    for (size_t i = 0; i < count; ++i)
+      work(i);
+    return;
+  }
+
+  std::atomic<size_t> next{0};
+  auto drain = [&]() {
+    for (size_t i = next++; i < count; i = next++)
+      work(i);
+  };
+  std::vector<std::thread> threads;
+  threads.reserve(threadCount - 1);
+  for (size_t t = 1; t < threadCount; ++t)
+    threads.emplace_back(drain);
+  drain(); // The calling thread takes a share too
+  for (auto &thread : threads)
+    thread.join();
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "filter.h"
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <sys/stat.h>
+
+// Recursively visits every regular file under root. Symlinks are not
+// followed and entries on other filesystems are skipped, so a walk can never
+// loop. Directories the matcher rejects are not descended into; file names
+// are checked before the lstat. Returns false if cancelled.
+bool walkTree(
+    const std::string &root, const EntryMatcher *matcher,
+    const std::function<void(const std::string &path, const struct stat &st)>
+        &visit,
+    const std::atomic<bool> *cancelled = nullptr);
+
+// Runs work(i) for every i in [0, count) on up to hardware_concurrency
+// threads, handing out indices from a shared counter. Blocks until all are
+// done.
+void runParallel(size_t count, const std::function<void(size_t i)> &work);
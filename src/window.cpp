@@ -0,0 +1,247 @@
+#include "window.h"
+#include "safeio.h"
+#include <algorithm>
+#include <cstring>
+#include <dirent.h>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+
+// The window is split into this many chunks; sliding drops one at an edge
+// and reads one at the other
+static const size_t WINDOW_CHUNKS = 4;
+
+// The open directory and what is known of its chunks. Only touched by the
+// guarded reads, one at a time.
+struct WindowedListing::Directory {
+  std::string path;
+  DIR *dir = nullptr;
+  size_t chunkSize = 0;
+  std::vector<long> chunkStarts; // telldir() cookie of each chunk's start
+  bool endKnown = false;
+  size_t totalEntries = 0;
+
+  ~Directory() {
+    if (dir != nullptr)
+      closedir(dir);
+  }
+
+  // Reads chunk k (appending to out if non-null). Returns the number of
+  // entries read; fewer than chunkSize means the end was reached.
+  size_t readChunk(size_t k, std::vector<FileEntry> *out);
+  // Reads chunks first.. until count are resident or the end is reached.
+  void loadWindow(size_t first, size_t count, std::vector<FileEntry> &files);
+};
+
+size_t WindowedListing::Directory::readChunk(size_t k,
+                                             std::vector<FileEntry> *out) {
+  // Walk forward through chunks we haven't located yet
+  while (chunkStarts.size() <= k) {
+    if (endKnown)
+      return 0;
+    readChunk(chunkStarts.size() - 1, nullptr);
+  }
+
+  const EntryMatcher &matcher = getScanMatcher();
+  std::string fullPath = path == "/" ? path : path + "/";
+  size_t baseLen = fullPath.size();
+
+  seekdir(dir, chunkStarts[k]);
+  size_t count = 0;
+  while (true) {
+    long position = telldir(dir);
+    struct dirent *entry = readdir(dir);
+    if (entry == nullptr) {
+      endKnown = true;
+      totalEntries = k * chunkSize + count;
+      break;
+    }
+    noteIoProgress();
+    if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+      continue;
+    if (!matcher.matchesName(entry->d_name))
+      continue;
+
+    if (count == chunkSize) {
+      // First entry of the next chunk: remember where it starts
+      if (chunkStarts.size() == k + 1)
+        chunkStarts.push_back(position);
+      break;
+    }
+
+    // Only entries kept for display need their type; d_type avoids the
+    // stat for everything but symlinks and DT_UNKNOWN. An entry whose stat
+    // fails (a dangling symlink) is kept as a file, so counting a chunk
+    // without stats finds the same entries as reading it.
+    bool isDir = entry->d_type == DT_DIR;
+    if (entry->d_type != DT_DIR && entry->d_type != DT_REG) {
+      if (!out && matcher.empty()) {
+        ++count;
+        continue;
+      }
+      fullPath.resize(baseLen);
+      fullPath += entry->d_name;
+      struct stat st;
+      isDir = stat(fullPath.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+    }
+    if (!matcher.matchesTyped(entry->d_name, isDir))
+      continue;
+    if (out)
+      out->emplace_back(entry->d_name, isDir);
+    ++count;
+  }
+  return count;
+}
+
+void WindowedListing::Directory::loadWindow(size_t first, size_t count,
+                                            std::vector<FileEntry> &files) {
+  files.reserve(chunkSize * count);
+  for (size_t k = first; k < first + count; ++k) {
+    if (readChunk(k, &files) < chunkSize)
+      break;
+  }
+}
+
+WindowedListing::~WindowedListing() { close(); }
+
+bool WindowedListing::open(const std::string &dirPath, size_t maxResident,
+                           std::vector<FileEntry> &files) {
+  close();
+  auto opened = std::make_shared<Directory>();
+  opened->path = dirPath;
+  opened->chunkSize = std::max<size_t>(maxResident / WINDOW_CHUNKS, 64);
+  // Owned by the read, which outlives this call if the mount hangs
+  auto loaded = std::make_shared<std::vector<FileEntry>>();
+  bool finished = runWithDeadline(dirPath, [opened, loaded]() {
+    opened->dir = opendir(opened->path.c_str());
+    if (opened->dir == nullptr)
+      return;
+    opened->chunkStarts.assign(1, telldir(opened->dir));
+    opened->loadWindow(0, WINDOW_CHUNKS, *loaded);
+  });
+  if (!finished || opened->dir == nullptr)
+    return false;
+  path = dirPath;
+  directory = std::move(opened);
+  chunksResident = WINDOW_CHUNKS;
+  firstChunk = 0;
+  files = std::move(*loaded);
+  return true;
+}
+
+void WindowedListing::close() {
+  // A read still running keeps the directory open until it returns
+  directory.reset();
+  path.clear();
+  firstChunk = 0;
+}
+
+bool WindowedListing::guarded(std::function<void(Directory &)> op) {
+  if (directory == nullptr)
+    return false;
+  auto shared = directory;
+  if (runWithDeadline(path, [shared, op]() { op(*shared); }))
+    return true;
+  close();
+  return false;
+}
+
+size_t WindowedListing::windowBase() const {
+  return directory ? firstChunk * directory->chunkSize : 0;
+}
+
+bool WindowedListing::totalKnown() const {
+  return directory && directory->endKnown;
+}
+
+size_t WindowedListing::total() const {
+  return directory ? directory->totalEntries : 0;
+}
+
+bool WindowedListing::follow(std::vector<FileEntry> &files, int &selectedIndex,
+                             int &topIndex) {
+  if (directory == nullptr || files.empty())
+    return false;
+  size_t chunkSize = directory->chunkSize;
+  bool changed = false;
+  bool moreAfter = !(directory->endKnown &&
+                     windowBase() + files.size() >= directory->totalEntries);
+
+  // Selection in the last resident chunk: drop the first chunk, read the next
+  while (moreAfter && selectedIndex >= (int)(chunkSize * (chunksResident - 1)) &&
+         files.size() == chunkSize * chunksResident) {
+    auto next = std::make_shared<std::vector<FileEntry>>();
+    auto read = std::make_shared<size_t>(0);
+    size_t k = firstChunk + chunksResident;
+    if (!guarded([next, read, k](Directory &d) {
+          *read = d.readChunk(k, next.get());
+        }))
+      return true;
+    if (*read == 0)
+      break;
+    files.erase(files.begin(), files.begin() + chunkSize);
+    files.insert(files.end(), std::make_move_iterator(next->begin()),
+                 std::make_move_iterator(next->end()));
+    ++firstChunk;
+    selectedIndex -= chunkSize;
+    topIndex = std::max(0, topIndex - (int)chunkSize);
+    changed = true;
+    moreAfter = *read == chunkSize;
+  }
+
+  // Selection in the first chunk: re-read the previous chunk via its cookie
+  while (firstChunk > 0 && selectedIndex < (int)chunkSize) {
+    auto previous = std::make_shared<std::vector<FileEntry>>();
+    size_t k = firstChunk - 1;
+    if (!guarded([previous, k](Directory &d) {
+          d.readChunk(k, previous.get());
+        }))
+      return true;
+    if (files.size() >= chunkSize * (chunksResident - 1))
+      files.resize(chunkSize * (chunksResident - 1));
+    files.insert(files.begin(), std::make_move_iterator(previous->begin()),
+                 std::make_move_iterator(previous->end()));
+    --firstChunk;
+    selectedIndex += previous->size();
+    topIndex += previous->size();
+    changed = true;
+  }
+  return changed;
+}
+
+void WindowedListing::jumpToStart(std::vector<FileEntry> &files,
+                                  int &selectedIndex, int &topIndex) {
+  auto loaded = std::make_shared<std::vector<FileEntry>>();
+  size_t count = chunksResident;
+  if (!guarded([loaded, count](Directory &d) {
+        d.loadWindow(0, count, *loaded);
+      }))
+    return;
+  files = std::move(*loaded);
+  firstChunk = 0;
+  selectedIndex = 0;
+  topIndex = 0;
+}
+
+void WindowedListing::jumpToEnd(std::vector<FileEntry> &files,
+                                int &selectedIndex, int &topIndex,
+                                int visibleRows) {
+  auto loaded = std::make_shared<std::vector<FileEntry>>();
+  auto first = std::make_shared<size_t>(0);
+  size_t count = chunksResident;
+  if (!guarded([loaded, first, count](Directory &d) {
+        // Locate every chunk start (names only, nothing kept) to find the
+        // end
+        while (!d.endKnown)
+          d.readChunk(d.chunkStarts.size() - 1, nullptr);
+        size_t lastChunk =
+            d.totalEntries == 0 ? 0 : (d.totalEntries - 1) / d.chunkSize;
+        *first = lastChunk + 1 > count ? lastChunk + 1 - count : 0;
+        d.loadWindow(*first, count, *loaded);
+      }))
+    return;
+  files = std::move(*loaded);
+  firstChunk = *first;
+  selectedIndex = files.empty() ? 0 : files.size() - 1;
+  topIndex = std::max(0, selectedIndex - visibleRows + 1);
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "utils.h"
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Bounded-memory view of a huge directory. Entries are read in fixed-size
+// chunks in readdir order and at most maxResident of them are held at once.
+// A sparse index of telldir() cookies (one per chunk) lets any chunk be
+// re-read with seekdir() instead of scanning from the start.
+//
+// Every read runs under the I/O deadline (see safeio.h). A read that misses
+// it closes the listing, which the read still running then owns, and the
+// mount shows as unresponsive.
+class WindowedListing {
+public:
+  WindowedListing() = default;
+  ~WindowedListing();
+
+  WindowedListing(const WindowedListing &) = delete;
+  WindowedListing &operator=(const WindowedListing &) = delete;
+
+  // Opens path and loads the first window into files. Returns false (and
+  // leaves files alone) if it can't be read.
+  bool open(const std::string &path, size_t maxResident,
+            std::vector<FileEntry> &files);
+  void close();
+  bool isOpen() const { return directory != nullptr; }
+  const std::string &getPath() const { return path; }
+
+  // Keeps the cursor inside the resident window, sliding it one chunk at a
+  // time when the selection reaches the first or last chunk. Returns true if
+  // files changed (or the listing closed).
+  bool follow(std::vector<FileEntry> &files, int &selectedIndex,
+              int &topIndex);
+  // Loads the window holding the first or last entry and selects it.
+  void jumpToStart(std::vector<FileEntry> &files, int &selectedIndex,
+                   int &topIndex);
+  void jumpToEnd(std::vector<FileEntry> &files, int &selectedIndex,
+                 int &topIndex, int visibleRows);
+
+  // Absolute position of files[0] in the directory
+  size_t windowBase() const;
+  bool totalKnown() const;
+  size_t total() const;
+
+private:
+  struct Directory;
+
+  // Runs op on the directory under the I/O deadline; on a miss closes the
+  // listing and returns false.
+  bool guarded(std::function<void(Directory &)> op);
+
+  std::string path;
+  // Shared with the guarded reads, which outlive the listing if they hang
+  std::shared_ptr<Directory> directory;
+  size_t chunksResident = 0;
+  size_t firstChunk = 0;
+};
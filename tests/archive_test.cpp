@@ -0,0 +1,328 @@
+#include "archive.h"
+#include "check.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+
+const size_t BLOCK = 512;
+
+// A ustar header block with a valid checksum. sizeField is written as is,
+// so cases can store sizes no tar tool would.
+std::string tarHeader(const std::string &name, char type,
+                      const std::string &sizeField) {
+  std::string block(BLOCK, '\0');
+  memcpy(&block[0], name.data(), std::min<size_t>(name.size(), 100));
+  memcpy(&block[100], "0000644", 8);
+  memcpy(&block[108], "0000000", 8);
+  memcpy(&block[116], "0000000", 8);
+  memcpy(&block[124], sizeField.data(),
+         std::min<size_t>(sizeField.size(), 12));
+  memcpy(&block[136], "00000000000", 12);
+  block[156] = type;
+  memcpy(&block[257], "ustar", 6);
+  memcpy(&block[263], "00", 2);
+  unsigned sum = 0;
+  for (size_t i = 0; i < BLOCK; ++i)
+    sum += (i >= 148 && i < 156) ? ' ' : (unsigned char)block[i];
+  snprintf(&block[148], 8, "%06o", sum);
+  block[155] = ' ';
+  return block;
+}
+
+std::string octalSize(uint64_t size) {
+  char field[12];
+  snprintf(field, sizeof(field), "%011llo", (unsigned long long)size);
+  return std::string(field, 12);
+}
+
+// A member with its data padded to whole blocks
+std::string tarMember(const std::string &name, const std::string &data,
+                      char type = '0') {
+  std::string member = tarHeader(name, type, octalSize(data.size())) + data;
+  member.resize((member.size() + BLOCK - 1) / BLOCK * BLOCK, '\0');
+  return member;
+}
+
+std::string tarEnd() { return std::string(2 * BLOCK, '\0'); }
+
+std::string pax(const std::string &key, const std::string &value) {
+  // "len key=value\n", where len counts itself
+  std::string body = " " + key + "=" + value + "\n";
+  size_t len = body.size() + 1;
+  while (std::to_string(len).size() + body.size() != len)
+    ++len;
+  return std::to_string(len) + body;
+}
+
+void testParseTarNumber() {
+  struct Case {
+    const char *label;
+    std::string field;
+    uint64_t expected;
+  } cases[] = {
+      {"octal with NUL", std::string("0000644\0", 8), 0644},
+      {"leading spaces", std::string("   644 \0", 8), 0644},
+      {"leading NULs", std::string("\0\0\0" "17", 5), 017},
+      {"empty", std::string(8, '\0'), 0},
+      {"stops at a non-octal digit", "12x4", 012},
+      {"eight is not octal", "18", 1},
+      {"full size field", "77777777777", 077777777777ULL},
+      {"base-256", std::string("\x80\0\0\0\0\0\0\0\0\0\x01\x00", 12), 256},
+      {"base-256 beyond octal range",
+       std::string("\x80\0\0\0\0\0\0\x02\0\0\0\0", 12), 1ULL << 33},
+  };
+  for (const Case &c : cases)
+    CHECK(parseTarNumber(c.field.data(), c.field.size()) == c.expected,
+          c.label);
+}
+
+void testTarIndex() {
+  const std::string hello = "hello";
+  std::string oneMember = tarMember("a.txt", hello);
+  std::string paxRecords = pax("path", "from/pax/header.txt");
+  struct Case {
+    const char *label;
+    std::string bytes;
+    std::vector<std::string> paths; // Empty: not read as an archive
+  } cases[] = {
+      {"one member", oneMember + tarEnd(), {"a.txt"}},
+      {"no end marker", oneMember + tarMember("b.txt", "bb"),
+       {"a.txt", "b.txt"}},
+      {"directory", tarMember("dir/", "", '5') + oneMember + tarEnd(),
+       {"dir", "a.txt"}},
+      {"GNU long name",
+       tarMember("././@LongLink", "a/very/long/name.txt", 'L') + oneMember +
+           tarEnd(),
+       {"a/very/long/name.txt"}},
+      {"pax path", tarMember("pax", paxRecords, 'x') + oneMember + tarEnd(),
+       {"from/pax/header.txt"}},
+      {"trailing garbage", oneMember + std::string(BLOCK, 'x'), {"a.txt"}},
+      {"header cut short",
+       oneMember + tarHeader("b", '0', octalSize(1)).substr(0, 100),
+       {"a.txt"}},
+      {"first member runs past the end",
+       tarHeader("big", '0', octalSize(4096)) + std::string(100, 'x'),
+       {}},
+      {"later member runs past the end",
+       oneMember + tarHeader("big", '0', octalSize(4096)) +
+           std::string(BLOCK, 'x'),
+       {"a.txt"}},
+      {"base-256 size that wraps the next offset",
+       oneMember + tarHeader("wrap", '0', std::string(12, '\xff')) + tarEnd(),
+       {"a.txt"}},
+      {"size of exactly the rest of the file",
+       tarHeader("exact", '0', octalSize(BLOCK)) + std::string(BLOCK, 'e'),
+       {"exact"}},
+      {"bad checksum", "b" + oneMember.substr(1) + tarEnd(), {}},
+  };
+
+  int n = 0;
+  for (const Case &c : cases) {
+    std::string path = writeScratchFile("case" + std::to_string(n++) + ".tar",
+                                        c.bytes);
+    auto index = loadArchiveIndex(path);
+    if (c.paths.empty()) {
+      CHECK(index == nullptr, c.label);
+      continue;
+    }
+    CHECK(index != nullptr, c.label);
+    if (!index)
+      continue;
+    CHECK(index->format == ArchiveIndex::Format::Tar, c.label);
+    for (const std::string &expected : c.paths)
+      CHECK(index->byPath.count(expected) == 1, c.label + (": " + expected));
+    if (index->byPath.count("a.txt")) {
+      const ArchiveMember &member =
+          index->members[index->byPath.at("a.txt")];
+      std::string contents;
+      CHECK(readArchiveMember(path, member, contents, 1 << 20) &&
+                contents == hello,
+            c.label);
+    }
+  }
+}
+
+void putLE16(std::string &out, uint16_t value) {
+  out.push_back(value & 0xff);
+  out.push_back(value >> 8);
+}
+
+void putLE32(std::string &out, uint32_t value) {
+  putLE16(out, value & 0xffff);
+  putLE16(out, value >> 16);
+}
+
+struct ZipMember {
+  std::string name;
+  uint16_t method; // 0 stored, 8 deflated
+  std::string packed;
+  uint32_t size;
+  uint32_t packedSize; // As recorded, which a case may make lie
+};
+
+// A zip with the given members and a central directory at the end. The
+// CRCs are left zero; they aren't checked when reading.
+std::string buildZip(const std::vector<ZipMember> &members,
+                     uint32_t directoryOffsetBias = 0) {
+  std::string zip;
+  std::vector<uint32_t> offsets;
+  for (const ZipMember &member : members) {
+    offsets.push_back(zip.size());
+    putLE32(zip, 0x04034b50);
+    putLE16(zip, 20);
+    putLE16(zip, 0);
+    putLE16(zip, member.method);
+    putLE16(zip, 0);
+    putLE16(zip, 0x21);
+    putLE32(zip, 0);
+    putLE32(zip, member.packedSize);
+    putLE32(zip, member.size);
+    putLE16(zip, member.name.size());
+    putLE16(zip, 0);
+    zip += member.name;
+    zip += member.packed;
+  }
+  uint32_t directoryOffset = zip.size();
+  for (size_t i = 0; i < members.size(); ++i) {
+    const ZipMember &member = members[i];
+    putLE32(zip, 0x02014b50);
+    putLE16(zip, 0x0314); // Unix, version 2.0
+    putLE16(zip, 20);
+    putLE16(zip, 0);
+    putLE16(zip, member.method);
+    putLE16(zip, 0);
+    putLE16(zip, 0x21);
+    putLE32(zip, 0);
+    putLE32(zip, member.packedSize);
+    putLE32(zip, member.size);
+    putLE16(zip, member.name.size());
+    putLE16(zip, 0);
+    putLE16(zip, 0);
+    putLE16(zip, 0);
+    putLE16(zip, 0);
+    putLE32(zip, 0100644u << 16);
+    putLE32(zip, offsets[i]);
+    zip += member.name;
+  }
+  uint32_t directorySize = zip.size() - directoryOffset;
+  putLE32(zip, 0x06054b50);
+  putLE16(zip, 0);
+  putLE16(zip, 0);
+  putLE16(zip, members.size());
+  putLE16(zip, members.size());
+  putLE32(zip, directorySize);
+  putLE32(zip, directoryOffset + directoryOffsetBias);
+  putLE16(zip, 0);
+  return zip;
+}
+
+std::string fromHex(const char *hex) {
+  std::string bytes;
+  for (size_t i = 0; hex[i] && hex[i + 1]; i += 2)
+    bytes.push_back((char)std::stoi(std::string(hex + i, 2), nullptr, 16));
+  return bytes;
+}
+
+ZipMember zipMember(const std::string &name, uint16_t method,
+                    const std::string &packed, const std::string &plain) {
+  return {name, method, packed, (uint32_t)plain.size(),
+          (uint32_t)packed.size()};
+}
+
+void testZip() {
+  // Raw deflate streams (zlib, wbits -15) of the plain texts below, one per
+  // block type
+  const std::string fixedPlain = "hello hello hello hello\n";
+  const std::string fixedPacked = fromHex("cb48cdc9c957c84027b900");
+  std::string dynamicPlain;
+  for (int i = 0; i < 40; ++i)
+    dynamicPlain += "line " + std::to_string(i) +
+                    ": the quick brown fox jumps over the lazy dog\n";
+  const std::string dynamicPacked = fromHex(
+      "9dd55b16c1500c46e177a3c810e40f2d66e37268397a68d56df41633b09fb3f653be95"
+      "e4b64b365dd9ad49761ddbedc9367d7974b62f4f3b8ee7cb60e59efadf38afdf2fdb95"
+      "c3247f1b078d4013a09981660e9a0a34356816a059929d22084482130a4e2c38c1e044"
+      "83130e4e3c3801e144848808a1db40448888101121224244848808111122228288082222"
+      "d0bb20228288082222888820228288883f457c00");
+  const std::string storedBlockPlain = "stored bytes, no compression\n";
+  const std::string storedBlockPacked = fromHex(
+      "011d00e2ff73746f7265642062797465732c206e6f20636f6d7072657373696f6e0a");
+  const std::string plain = "not compressed at all\n";
+
+  ZipMember truncated = zipMember("cut.txt", 8, dynamicPacked.substr(0, 60),
+                                  dynamicPlain);
+  ZipMember overlong = zipMember("long.txt", 0, plain, plain);
+  overlong.packedSize = overlong.size = 1 << 20;
+
+  struct Case {
+    const char *label;
+    std::string bytes;
+    std::string member;   // Read back; "" for none
+    std::string expected; // Its contents; "" if reading must fail
+    size_t maxBytes;
+  } cases[] = {
+      {"stored member", buildZip({zipMember("plain.txt", 0, plain, plain)}),
+       "plain.txt", plain, 1 << 20},
+      {"fixed Huffman",
+       buildZip({zipMember("fixed.txt", 8, fixedPacked, fixedPlain)}),
+       "fixed.txt", fixedPlain, 1 << 20},
+      {"dynamic Huffman",
+       buildZip({zipMember("dynamic.txt", 8, dynamicPacked, dynamicPlain)}),
+       "dynamic.txt", dynamicPlain, 1 << 20},
+      {"dynamic Huffman, first bytes only",
+       buildZip({zipMember("dynamic.txt", 8, dynamicPacked, dynamicPlain)}),
+       "dynamic.txt", dynamicPlain.substr(0, 100), 100},
+      {"stored deflate block",
+       buildZip({zipMember("block.txt", 8, storedBlockPacked,
+                           storedBlockPlain)}),
+       "block.txt", storedBlockPlain, 1 << 20},
+      {"several members",
+       buildZip({zipMember("plain.txt", 0, plain, plain),
+                 zipMember("fixed.txt", 8, fixedPacked, fixedPlain)}),
+       "fixed.txt", fixedPlain, 1 << 20},
+      {"deflate stream cut short", buildZip({truncated}), "cut.txt", "",
+       1 << 20},
+      {"member runs past the end", buildZip({overlong}), "long.txt", "",
+       1 << 20},
+  };
+
+  int n = 0;
+  for (const Case &c : cases) {
+    std::string path = writeScratchFile("case" + std::to_string(n++) + ".zip",
+                                        c.bytes);
+    auto index = loadArchiveIndex(path);
+    CHECK(index != nullptr, c.label);
+    if (!index)
+      continue;
+    CHECK(index->format == ArchiveIndex::Format::Zip, c.label);
+    auto found = index->byPath.find(c.member);
+    CHECK(found != index->byPath.end(), c.label);
+    if (found == index->byPath.end())
+      continue;
+    std::string contents;
+    bool read =
+        readArchiveMember(path, index->members[found->second], contents,
+                          c.maxBytes);
+    if (c.expected.empty())
+      CHECK(!read, c.label);
+    else
+      CHECK(read && contents == c.expected, c.label);
+  }
+
+  std::string pastEnd =
+      buildZip({zipMember("plain.txt", 0, plain, plain)}, 1 << 20);
+  CHECK(loadArchiveIndex(writeScratchFile("past-end.zip", pastEnd)) == nullptr,
+        "central directory past the end");
+}
+
+} // namespace
+
+void testArchives() {
+  testParseTarNumber();
+  testTarIndex();
+  testZip();
+}
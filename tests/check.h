@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdio>
+#include <string>
+
+// Checks failed so far. A failed check reports itself and the run carries
+// on, so one broken case doesn't hide the others in its table.
+extern int failedChecks;
+
+#define CHECK(cond, label)                                                     \
+  do {                                                                         \
+    if (!(cond)) {                                                             \
+      fprintf(stderr, "%s:%d: %s: %s\n", __FILE__, __LINE__,                   \
+              std::string(label).c_str(), #cond);                              \
+      failedChecks++;                                                          \
+    }                                                                          \
+  } while (0)
+
+// Writes data to a new file named name in the run's scratch directory and
+// returns its path.
+std::string writeScratchFile(const std::string &name, const std::string &data);
+
+// One suite per file
+void testArchives();
+void testGitIndex();
+void testNaturalSort();
+void testSniffContent();
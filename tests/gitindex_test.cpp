@@ -0,0 +1,157 @@
+#include "check.h"
+#include "gitstatus.h"
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace {
+
+void putBE16(std::string &out, uint16_t value) {
+  out.push_back(value >> 8);
+  out.push_back(value & 0xff);
+}
+
+void putBE32(std::string &out, uint32_t value) {
+  putBE16(out, value >> 16);
+  putBE16(out, value & 0xffff);
+}
+
+struct IndexPath {
+  std::string path;
+  int stage = 0;         // Merge stage; non-zero for a conflict
+  bool extended = false; // Carries the v3 extended flags
+};
+
+// An index file in the given version, written the way git does: v2/v3 paths
+// NUL-padded to a multiple of 8 bytes, v4 paths prefix-compressed against
+// the previous one. Entry i gets mtime 1000 + i and size 10 * i.
+std::string buildIndex(uint32_t version, const std::vector<IndexPath> &paths) {
+  std::string index = "DIRC";
+  putBE32(index, version);
+  putBE32(index, paths.size());
+  std::string previous;
+  for (size_t i = 0; i < paths.size(); ++i) {
+    const IndexPath &entry = paths[i];
+    size_t start = index.size();
+    putBE32(index, 0);        // ctime
+    putBE32(index, 0);
+    putBE32(index, 1000 + i); // mtime
+    putBE32(index, 0);
+    putBE32(index, 0);        // dev
+    putBE32(index, 42 + i);   // ino
+    putBE32(index, 0100644);
+    putBE32(index, 0);        // uid
+    putBE32(index, 0);        // gid
+    putBE32(index, 10 * i);
+    index.append(20, '\0');   // Object id
+    uint16_t flags = std::min<size_t>(entry.path.size(), 0xfff) |
+                     (entry.stage << 12) | (entry.extended ? 0x4000 : 0);
+    putBE16(index, flags);
+    if (entry.extended)
+      putBE16(index, 0x2000); // Intent to add
+    if (version == 4) {
+      size_t common = 0;
+      while (common < previous.size() && common < entry.path.size() &&
+             previous[common] == entry.path[common])
+        ++common;
+      // git's offset varint: each continuation byte adds one before shifting
+      uint64_t strip = previous.size() - common;
+      unsigned char varint[16];
+      int pos = sizeof(varint) - 1;
+      varint[pos] = strip & 127;
+      while (strip >>= 7)
+        varint[--pos] = 128 | (--strip & 127);
+      index.append(reinterpret_cast<char *>(varint + pos), sizeof(varint) - pos);
+      index += entry.path.substr(common);
+      index.push_back('\0');
+    } else {
+      index += entry.path;
+      size_t len = index.size() - start;
+      index.append(8 - len % 8, '\0');
+    }
+    previous = entry.path;
+  }
+  index.append(20, '\0'); // Checksum; not verified by the parser
+  return index;
+}
+
+void testValidIndexes() {
+  std::string deep(200, 'd');
+  std::vector<IndexPath> paths = {
+      {"Makefile"},
+      {"src/a.cpp"},
+      {"src/a.h"},
+      {"src/sub/b.txt"},
+      {deep + "/one"},
+      {"x", 2},
+      {"y", 0, true},
+  };
+  struct Case {
+    const char *label;
+    uint32_t version;
+    std::vector<IndexPath> paths;
+  } cases[] = {
+      {"version 2", 2, {paths.begin(), paths.end() - 1}},
+      {"version 3 with extended flags", 3, paths},
+      {"version 4", 4, paths},
+      {"version 4, strip over 127 bytes", 4, {{deep + "/one"}, {"two"}}},
+      {"empty", 2, {}},
+  };
+  for (const Case &c : cases) {
+    std::string data = buildIndex(c.version, c.paths);
+    std::vector<GitIndexEntry> entries;
+    bool ok = parseGitIndex(reinterpret_cast<const unsigned char *>(data.data()),
+                            data.size(), entries);
+    CHECK(ok, c.label);
+    CHECK(entries.size() == c.paths.size(), c.label);
+    for (size_t i = 0; i < entries.size() && i < c.paths.size(); ++i) {
+      std::string label = c.label + (": " + c.paths[i].path.substr(0, 20));
+      CHECK(entries[i].path == c.paths[i].path, label);
+      CHECK(entries[i].mtimeSec == 1000 + i, label);
+      CHECK(entries[i].ino == 42 + i, label);
+      CHECK(entries[i].mode == 0100644, label);
+      CHECK(entries[i].size == 10 * i, label);
+      CHECK(entries[i].conflicted == (c.paths[i].stage != 0), label);
+    }
+  }
+}
+
+void testMalformedIndexes() {
+  std::vector<IndexPath> paths = {{"a"}, {"b/c"}};
+  std::string v2 = buildIndex(2, paths);
+  std::string v4 = buildIndex(4, paths);
+  std::string badStrip = v4;
+  // The second entry's strip count sits right after its 62 fixed bytes
+  size_t secondEntry = 12 + 62 + 1 + 2;
+  badStrip[secondEntry + 62] = 5;
+
+  struct Case {
+    const char *label;
+    std::string data;
+  } cases[] = {
+      {"too short for a header", "DIRC"},
+      {"wrong signature", "CRID" + v2.substr(4)},
+      {"version 1", v2.substr(0, 7) + '\x01' + v2.substr(8)},
+      {"version 5", v2.substr(0, 7) + '\x05' + v2.substr(8)},
+      {"cut in an entry's fixed fields", v2.substr(0, 12 + 40)},
+      {"cut in a path", v2.substr(0, 12 + 62)},
+      {"v4 cut before the strip count", v4.substr(0, 12 + 62)},
+      {"v4 strips more than the previous path", badStrip},
+      {"more entries than the file holds",
+       v2.substr(0, 11) + '\x09' + v2.substr(12)},
+  };
+  for (const Case &c : cases) {
+    std::vector<GitIndexEntry> entries;
+    CHECK(!parseGitIndex(reinterpret_cast<const unsigned char *>(c.data.data()),
+                         c.data.size(), entries),
+          c.label);
+  }
+}
+
+} // namespace
+
+void testGitIndex() {
+  testValidIndexes();
+  testMalformedIndexes();
+}
@@ -0,0 +1,44 @@
+#include "check.h"
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+
+namespace fs = std::filesystem;
+
+int failedChecks = 0;
+
+namespace {
+
+std::string scratchDir;
+
+} // namespace
+
+std::string writeScratchFile(const std::string &name, const std::string &data) {
+  std::string path = scratchDir + "/" + name;
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  out.write(data.data(), data.size());
+  return path;
+}
+
+int main() {
+  char dirTemplate[] = "/tmp/peek-tests.XXXXXX";
+  if (!mkdtemp(dirTemplate)) {
+    perror("mkdtemp");
+    return 1;
+  }
+  scratchDir = dirTemplate;
+
+  testArchives();
+  testGitIndex();
+  testNaturalSort();
+  testSniffContent();
+
+  std::error_code ignored;
+  fs::remove_all(scratchDir, ignored);
+  if (failedChecks > 0) {
+    fprintf(stderr, "%d checks failed\n", failedChecks);
+    return 1;
+  }
+  printf("All tests passed\n");
+  return 0;
+}
@@ -0,0 +1,69 @@
+#include "check.h"
+#include "sniff.h"
+#include <string>
+
+namespace {
+
+const char *kindName(ContentKind kind) {
+  switch (kind) {
+  case ContentKind::Unknown:
+    return "Unknown";
+  case ContentKind::Executable:
+    return "Executable";
+  case ContentKind::Script:
+    return "Script";
+  case ContentKind::Archive:
+    return "Archive";
+  case ContentKind::Image:
+    return "Image";
+  case ContentKind::Text:
+    return "Text";
+  case ContentKind::Binary:
+    return "Binary";
+  }
+  return "?";
+}
+
+} // namespace
+
+void testSniffContent() {
+  struct Case {
+    const char *label;
+    std::string head;
+    ContentKind expected;
+  } cases[] = {
+      {"empty", "", ContentKind::Unknown},
+      {"ELF", std::string("\x7f" "ELF\x02\x01\x01\0", 8),
+       ContentKind::Executable},
+      {"Mach-O 64-bit", std::string("\xcf\xfa\xed\xfe\x07\0\0\x01", 8),
+       ContentKind::Executable},
+      {"universal binary", std::string("\xca\xfe\xba\xbe\0\0\0\x02", 8),
+       ContentKind::Executable},
+      {"shebang", "#!/bin/sh\necho hi\n", ContentKind::Script},
+      {"gzip", std::string("\x1f\x8b\x08\0", 4), ContentKind::Archive},
+      {"zstd", std::string("\x28\xb5\x2f\xfd", 4), ContentKind::Archive},
+      {"zip", std::string("PK\x03\x04\x14\0", 6), ContentKind::Archive},
+      {"empty zip", std::string("PK\x05\x06", 4), ContentKind::Archive},
+      {"PNG", std::string("\x89PNG\r\n\x1a\n\0\0\0\rIHDR", 16),
+       ContentKind::Image},
+      {"ASCII", "plain text\twith a tab\r\n", ContentKind::Text},
+      {"colored log", "\x1b[31merror\x1b[0m\n", ContentKind::Text},
+      {"UTF-8", "caf\xc3\xa9 \xe2\x82\xac \xf0\x9f\x98\x80\n",
+       ContentKind::Text},
+      {"UTF-8 cut by the buffer", "caf\xe2\x82", ContentKind::Text},
+      {"NUL byte", std::string("text\0more", 9), ContentKind::Binary},
+      {"other control", "bell\x07", ContentKind::Binary},
+      {"DEL", "del\x7f", ContentKind::Binary},
+      {"overlong encoding", "\xc0\xaf", ContentKind::Binary},
+      {"lone continuation byte", "a\x80" "b", ContentKind::Binary},
+      {"bad continuation", "\xe2\x28\xa1", ContentKind::Binary},
+      {"Latin-1", "caf\xe9 au lait", ContentKind::Binary},
+      {"magic too short", "#", ContentKind::Text},
+  };
+  for (const Case &c : cases) {
+    ContentKind kind = sniffContent(
+        reinterpret_cast<const unsigned char *>(c.head.data()), c.head.size());
+    CHECK(kind == c.expected,
+          c.label + std::string(": got ") + kindName(kind));
+  }
+}
@@ -0,0 +1,74 @@
+#include "check.h"
+#include "sort.h"
+#include <string>
+#include <vector>
+
+namespace {
+
+bool naturalLess(const std::string &a, const std::string &b) {
+  return makeCollationKey(a, NameSort::Natural) <
+         makeCollationKey(b, NameSort::Natural);
+}
+
+void testNaturalPairs() {
+  std::string longNumber(300, '1');
+  // first sorts strictly before second
+  struct Case {
+    std::string first;
+    std::string second;
+  } cases[] = {
+      {"part9", "part10"},
+      {"file", "file1"},
+      {"x2y", "x10y"},
+      {"img007", "img12"},
+      {"v1.9", "v1.10"},
+      {"9a", "10"},
+      {"1abc", "abc"},        // Digits before letters, as in ASCII
+      {"a", "Z"},             // Case-insensitive
+      {"a2", "B1"},
+      {"a01", "a1"},          // Equal values: the raw name breaks the tie
+      {"0", "00"},
+      {"a1b2", "a1b10"},
+      {"a1b10", "a2b1"},
+      {"", "0"},
+      {longNumber, longNumber + "1"}, // Past the 255-digit length byte
+      {"\xc3\xa9t\xc3\xa9" "2", "\xc3\xa9t\xc3\xa9" "10"}, // UTF-8 text
+  };
+  for (const Case &c : cases) {
+    std::string label = c.first.substr(0, 20) + " < " + c.second.substr(0, 20);
+    CHECK(naturalLess(c.first, c.second), label);
+    CHECK(!naturalLess(c.second, c.first), label);
+  }
+}
+
+void testSortByName() {
+  struct Case {
+    const char *label;
+    NameSort mode;
+    std::vector<std::string> expected;
+  } cases[] = {
+      {"natural", NameSort::Natural,
+       {"File1", "file2", "file10", "File20", "notes"}},
+      {"bytewise", NameSort::Byte,
+       {"File1", "File20", "file10", "file2", "notes"}},
+      {"case-insensitive", NameSort::CaseInsensitive,
+       {"File1", "file10", "file2", "File20", "notes"}},
+  };
+  for (const Case &c : cases) {
+    std::vector<FileEntry> entries;
+    for (auto it = c.expected.rbegin(); it != c.expected.rend(); ++it)
+      entries.emplace_back(*it, false);
+    sortByName(entries, c.mode);
+    std::vector<std::string> sorted;
+    for (const FileEntry &entry : entries)
+      sorted.push_back(entry.name);
+    CHECK(sorted == c.expected, c.label);
+  }
+}
+
+} // namespace
+
+void testNaturalSort() {
+  testNaturalPairs();
+  testSortByName();
+}